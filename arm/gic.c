@@ -13,6 +13,8 @@
  */
 #include <libcflat.h>
 #include <errata.h>
+#include <migrate.h>
+#include <util.h>
 #include <asm/setup.h>
 #include <asm/processor.h>
 #include <asm/delay.h>
@@ -613,6 +615,7 @@ static void test_its_trigger(void) {}
 static void test_its_migration(void) {}
 static void test_its_pending_migration(void) {}
 static void test_migrate_unmapped_collection(void) {}
+static void test_its_migration_scale(int argc, char **argv) {}
 
 #else /* __aarch64__ */
 
@@ -695,8 +698,8 @@ static int its_setup1(void)
 	if (its_prerequisites(4))
 		return -1;
 
-	dev2 = its_create_device(2 /* dev id */, 8 /* nb_ites */);
-	dev7 = its_create_device(7 /* dev id */, 8 /* nb_ites */);
+	dev2 = its_create_device(2 /* dev id */, 256 /* nb_ites */);
+	dev7 = its_create_device(7 /* dev id */, 256 /* nb_ites */);
 
 	col3 = its_create_collection(3 /* col id */, 3/* target PE */);
 	col2 = its_create_collection(2 /* col id */, 2/* target PE */);
@@ -804,9 +807,7 @@ static void test_its_migration(void)
 	dev7 = its_get_device(7);
 
 do_migrate:
-	puts("Now migrate the VM, then press a key to continue...\n");
-	(void)getchar();
-	report_info("Migration complete");
+	migrate();
 	if (test_skipped)
 		return;
 
@@ -850,9 +851,7 @@ static void test_migrate_unmapped_collection(void)
 	gicv3_lpi_set_config(8192, LPI_PROP_DEFAULT);
 
 do_migrate:
-	puts("Now migrate the VM, then press a key to continue...\n");
-	(void)getchar();
-	report_info("Migration complete");
+	migrate();
 	if (test_skipped)
 		return;
 
@@ -889,7 +888,7 @@ static void test_its_pending_migration(void)
 		goto do_migrate;
 	}
 
-	dev = its_create_device(2 /* dev id */, 8 /* nb_ites */);
+	dev = its_create_device(2 /* dev id */, 256 /* nb_ites */);
 	its_send_mapd(dev, true);
 
 	collection[0] = its_create_collection(pe0, pe0);
@@ -931,9 +930,7 @@ static void test_its_pending_migration(void)
 	gicv3_lpi_rdist_enable(pe1);
 
 do_migrate:
-	puts("Now migrate the VM, then press a key to continue...\n");
-	(void)getchar();
-	report_info("Migration complete");
+	migrate();
 	if (test_skipped)
 		return;
 
@@ -942,6 +939,124 @@ do_migrate:
 
 	check_lpi_hits(expected, "128 LPIs on both PE0 and PE1 after migration");
 }
+
+/*
+ * Build an ITS state of configurable size and migrate it, to see how the
+ * downtime that the runner prints after each migration grows with the
+ * ITS tables and pending tables that KVM saves and restores:
+ *   devices=N  number of devices, each with its own ITT
+ *   events=N   events (and LPIs) per device, spread over the collections
+ *   pending=N  LPIs that are pending across the migration
+ *   migrations=N
+ * Compare against devices=0 pending=0, which migrates an empty ITS.
+ *
+ * The pending LPIs are disabled in the configuration table, so that they
+ * stay pending in KVM while the redistributors have LPIs enabled; they
+ * are enabled, and delivered, only after the last migration.
+ */
+static void test_its_migration_scale(int argc, char **argv)
+{
+	long nr_devices = 1024, nr_events = 32, nr_pending = 4096;
+	long nr_migrations = 1, val;
+	struct its_collection *col[GITS_MAX_COLLECTIONS];
+	int *expected = calloc(nr_cpus, sizeof(int));
+	struct its_device *dev;
+	int nr_cols, cpu, d, e, i, len, lpi = 0, delivered;
+	bool test_skipped = false;
+	u64 pendbaser, t0;
+	void *ptr;
+
+	for (i = 2; i < argc; i++) {
+		len = parse_keyval(argv[i], &val);
+		if (len == -1)
+			report_abort("bad argument '%s'", argv[i]);
+		argv[i][len] = '\0';
+		if (!strcmp(argv[i], "devices"))
+			nr_devices = val;
+		else if (!strcmp(argv[i], "events"))
+			nr_events = val;
+		else if (!strcmp(argv[i], "pending"))
+			nr_pending = val;
+		else if (!strcmp(argv[i], "migrations"))
+			nr_migrations = val;
+		else
+			report_abort("unknown argument '%s'", argv[i]);
+	}
+
+	if (nr_devices < 0 || nr_devices > GITS_MAX_DEVICES ||
+	    nr_events < 1 || nr_devices * nr_events > LPI_NR ||
+	    nr_pending < 0 || nr_pending > nr_devices * nr_events ||
+	    nr_migrations < 1)
+		report_abort("at most %d devices and %d LPIs, pending LPIs must be mapped",
+			     GITS_MAX_DEVICES, LPI_NR);
+
+	if (its_prerequisites(1)) {
+		test_skipped = true;
+		goto do_migrate;
+	}
+
+	t0 = get_cntvct();
+
+	nr_cols = MIN(nr_cpus, GITS_MAX_COLLECTIONS);
+	for (i = 0; i < nr_cols; i++) {
+		col[i] = its_create_collection(i, i);
+		its_send_mapc_nv(col[i], true);
+	}
+
+	for (d = 0; d < nr_devices; d++) {
+		dev = its_create_device(d, nr_events);
+		its_send_mapd_nv(dev, true);
+		for (e = 0; e < nr_events; e++, lpi++) {
+			i = lpi % nr_cols;
+			if (lpi < nr_pending) {
+				gicv3_lpi_set_config(LPI(lpi), LPI_PROP_DEFAULT & ~LPI_PROP_ENABLED);
+				gicv3_lpi_set_clr_pending(i, LPI(lpi), true);
+				expected[i]++;
+			} else {
+				gicv3_lpi_set_config(LPI(lpi), LPI_PROP_DEFAULT);
+			}
+			its_send_mapti_nv(dev, LPI(lpi), e, col[i]);
+		}
+	}
+
+	/* Let KVM read the pending tables again, now that they are filled */
+	for (i = 0; i < nr_cols; i++) {
+		gicv3_lpi_rdist_disable(i);
+		ptr = gicv3_data.redist_base[i] + GICR_PENDBASER;
+		pendbaser = readq(ptr);
+		writeq(pendbaser & ~GICR_PENDBASER_PTZ, ptr);
+		gicv3_lpi_rdist_enable(i);
+		its_send_invall_nv(col[i]);
+	}
+
+	report_info("%ld devices, %ld events each, %ld pending LPIs on %d collections, set up in %" PRIu64 " ms",
+		    nr_devices, nr_events, nr_pending, nr_cols,
+		    (get_cntvct() - t0) * 1000 / get_cntfrq());
+
+do_migrate:
+	for (i = 0; i < nr_migrations; i++)
+		migrate();
+	if (test_skipped)
+		return;
+
+	for (lpi = 0; lpi < nr_pending; lpi++)
+		gicv3_lpi_set_config(LPI(lpi), LPI_PROP_DEFAULT);
+	for (i = 0; i < nr_cols; i++)
+		its_send_invall_nv(col[i]);
+
+	/* Wait up to 5s for all the pending LPIs */
+	for (i = 0; i < 500; i++) {
+		smp_rmb(); /* pairs with wmb in lpi_handler */
+		delivered = 0;
+		for_each_present_cpu(cpu)
+			delivered += acked[cpu];
+		if (delivered >= nr_pending)
+			break;
+		mdelay(10);
+	}
+
+	check_lpi_hits(expected, "pending LPIs delivered after migration");
+}
 #endif
 
 int main(int argc, char **argv)
@@ -991,6 +1106,10 @@ int main(int argc, char **argv)
 		report_prefix_push(argv[1]);
 		test_migrate_unmapped_collection();
 		report_prefix_pop();
+	} else if (!strcmp(argv[1], "its-migration-scale")) {
+		report_prefix_push(argv[1]);
+		test_its_migration_scale(argc, argv);
+		report_prefix_pop();
 	} else if (strcmp(argv[1], "its-introspection") == 0) {
 		report_prefix_push(argv[1]);
 		test_its_introspection();
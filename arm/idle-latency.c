@@ -0,0 +1,181 @@
+/*
+ * Idle wake-up latency benchmark
+ *
+ * CPU 0 waits in WFI and is woken up after a given idle time, either by
+ * an SGI from CPU 1 or by the virtual timer; the latency is the time from
+ * sending the SGI, or from the timer deadline, to the start of the
+ * interrupt handler.  The idle time is swept from 500 ns to 5 ms, which
+ * covers the range where KVM's halt_poll_ns decides between polling and
+ * blocking, so compare runs with different settings of it.
+ *
+ * Usage: idle-latency.flat [samples]
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include <libcflat.h>
+#include <bench.h>
+#include <clock.h>
+#include <asm/barrier.h>
+#include <asm/gic.h>
+#include <asm/io.h>
+#include <asm/processor.h>
+#include <asm/smp.h>
+#include <asm/timer.h>
+
+#define WAKE_SGI		1
+#define DEFAULT_SAMPLES		200
+#define MAX_SAMPLES		2000
+
+static const u64 idle_ns[] = {
+	500, 1000, 2000, 5000, 10000, 20000, 50000,
+	100000, 200000, 500000, 1000000, 2000000, 5000000,
+};
+
+static u64 lat_ns[MAX_SAMPLES];
+
+static volatile bool woken, sender_stop, sender_ready;
+static volatile u64 rx_cnt, send_cnt, halt_cnt, idle_ticks;
+static volatile unsigned int halt_seq;
+
+static void wake_handler(struct pt_regs *regs)
+{
+	u32 irqstat = gic_read_iar();
+	u32 irqnr = gic_iar_irqnr(irqstat);
+
+	rx_cnt = get_clock_ticks();
+	if (irqnr == GICC_INT_SPURIOUS)
+		return;
+	if (irqnr == PPI(TIMER_VTIMER_IRQ)) {
+		write_sysreg(ARCH_TIMER_CTL_IMASK | ARCH_TIMER_CTL_ENABLE,
+			     cntv_ctl_el0);
+		isb();
+	}
+	gic_write_eoir(irqstat);
+	woken = true;
+}
+
+static void wait_for_wakeup(void)
+{
+	while (!woken) {
+		/* A pending interrupt wakes up WFI even when masked */
+		wfi();
+		local_irq_enable();
+		local_irq_disable();
+	}
+}
+
+/* Runs on CPU 1: send an SGI once CPU 0 has been idle for idle_ticks. */
+static void sgi_sender(void *data)
+{
+	unsigned int seq = halt_seq;
+	u64 t;
+
+	gic_enable_defaults();
+	sender_ready = true;
+	while (!sender_stop) {
+		if (halt_seq == seq) {
+			cpu_relax();
+			continue;
+		}
+		seq = halt_seq;
+		smp_rmb();
+		t = halt_cnt + idle_ticks;
+		while (get_clock_ticks() < t)
+			cpu_relax();
+		send_cnt = get_clock_ticks();
+		gic_ipi_send_single(WAKE_SGI, 0);
+	}
+	sender_ready = false;
+}
+
+static u64 sgi_wakeup(void)
+{
+	local_irq_disable();
+	woken = false;
+	halt_cnt = get_clock_ticks();
+	smp_wmb();
+	halt_seq++;
+	wait_for_wakeup();
+	return rx_cnt - send_cnt;
+}
+
+static u64 timer_wakeup(void)
+{
+	u64 deadline;
+
+	local_irq_disable();
+	woken = false;
+	deadline = get_clock_ticks() + idle_ticks;
+	write_sysreg(deadline, cntv_cval_el0);
+	write_sysreg(ARCH_TIMER_CTL_ENABLE, cntv_ctl_el0);
+	isb();
+	wait_for_wakeup();
+	return rx_cnt - deadline;
+}
+
+static void sweep(const char *name, u64 (*wakeup)(void), int samples)
+{
+	int i, n;
+
+	for (i = 0; i < ARRAY_SIZE(idle_ns); i++) {
+		idle_ticks = get_clock_hz() * idle_ns[i] / NSEC_PER_SEC;
+		for (n = 0; n < samples; n++) {
+			u64 ticks = wakeup();
+
+			/* The deadline may already have passed before WFI */
+			lat_ns[n] = (s64)ticks > 0 ? clock_ticks_to_ns(ticks) : 0;
+		}
+		printf("%-6s %10" PRIu64, name, idle_ns[i]);
+		bench_print_percentiles(lat_ns, samples);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int samples = argc > 1 ? atol(argv[1]) : DEFAULT_SAMPLES;
+	void *gic_isenabler;
+
+	samples = MAX(1, MIN(samples, MAX_SAMPLES));
+	if (!gic_init()) {
+		report_skip("No supported gic present");
+		return report_summary();
+	}
+
+	gic_enable_defaults();
+	install_irq_handler(EL1H_IRQ, wake_handler);
+
+	printf("%d samples per point, wake-up latency in ns\n", samples);
+	printf("%-6s %10s", "event", "idle ns");
+	bench_print_percentiles_header();
+
+	if (nr_cpus > 1) {
+		on_cpu_async(1, sgi_sender, NULL);
+		while (!sender_ready)
+			cpu_relax();
+		sweep("sgi", sgi_wakeup, samples);
+		sender_stop = true;
+		while (sender_ready)
+			cpu_relax();
+		report(true, "SGI wake-up");
+	} else {
+		report_skip("SGI wake-up needs at least two CPUs");
+	}
+
+	switch (gic_version()) {
+	case 2:
+		gic_isenabler = gicv2_dist_base() + GICD_ISENABLER;
+		break;
+	case 3:
+		gic_isenabler = gicv3_sgi_base() + GICR_ISENABLER0;
+		break;
+	default:
+		assert_msg(0, "Unreachable");
+	}
+	writel(1 << PPI(TIMER_VTIMER_IRQ), gic_isenabler);
+	sweep("vtimer", timer_wakeup, samples);
+	write_sysreg(0, cntv_ctl_el0);
+	isb();
+	report(true, "vtimer wake-up");
+
+	return report_summary();
+}
@@ -0,0 +1 @@
+../x86/jitter.c
\ No newline at end of file
@@ -19,12 +19,16 @@
  * This work is licensed under the terms of the GNU LGPL, version 2.
  */
 #include <libcflat.h>
+#include <bench.h>
+#include <clock.h>
+#include <pci.h>
+#include <pci-bench.h>
 #include <asm/gic.h>
 #include <asm/gic-v3-its.h>
+#include <asm/io.h>
+#include <asm/page.h>
 #include <asm/timer.h>
 
-#define NS_5_SECONDS (5 * 1000 * 1000 * 1000UL)
-
 static u32 cntfrq;
 
 static volatile bool irq_ready, irq_received;
@@ -88,7 +92,7 @@ static bool test_init(void)
 	on_cpu_async(1, gic_secondary_entry, NULL);
 
 	cntfrq = get_cntfrq();
-	printf("Timer Frequency %d Hz (Output in microseconds)\n", cntfrq);
+	printf("Timer Frequency %d Hz\n", cntfrq);
 
 	return true;
 }
@@ -258,14 +262,18 @@ static void timer_exec(void)
 	assert_msg(irq_received, "failed to receive PPI in time, but received %d successfully\n", received);
 }
 
-static void timer_post(uint64_t ntimes, uint64_t *total_ticks)
+static u64 timer_measure(void)
 {
+	u64 start = get_clock_ticks();
+
+	timer_exec();
+
 	/*
 	 * We use a 10msec timer to test the latency of PPI,
 	 * so we substract the ticks of 10msec to get the
 	 * actual latency
 	 */
-	*total_ticks -= ntimes * (cntfrq / 100);
+	return get_clock_ticks() - start - cntfrq / 100;
 }
 
 static void hvc_exec(void)
@@ -273,17 +281,25 @@ static void hvc_exec(void)
 	asm volatile("mov w0, #0x4b000000; hvc #0" ::: "w0");
 }
 
-static void mmio_read_user_exec(void)
+/* pci-testdev, found through the PCI host bridge in the device tree */
+static void __iomem *pci_mem;
+
+static bool pci_prep(void)
 {
-	/*
-	 * FIXME: Read device-id in virtio mmio here in order to
-	 * force an exit to userspace. This address needs to be
-	 * updated in the future if any relevant changes in QEMU
-	 * test-dev are made.
-	 */
-	void *userspace_emulated_addr = (void*)0x0a000008;
+	static bool probed;
+
+	if (!probed) {
+		probed = true;
+		if (pci_probe() && pci_bench_init())
+			pci_mem = pci_bench_mem();
+	}
+	return pci_mem;
+}
 
-	readl(userspace_emulated_addr);
+static void mmio_read_user_exec(void)
+{
+	/* Exits to userspace, like all reads of pci-testdev */
+	readl(pci_mem);
 }
 
 static void mmio_read_vgic_exec(void)
@@ -299,96 +315,31 @@ static void eoi_exec(void)
 	write_eoir(spurious_id);
 }
 
-struct exit_test {
-	const char *name;
-	bool (*prep)(void);
-	void (*exec)(void);
-	void (*post)(uint64_t ntimes, uint64_t *total_ticks);
-	u32 times;
-	bool run;
-};
-
-static struct exit_test tests[] = {
-	{"hvc",			NULL,		hvc_exec,		NULL,		65536,		true},
-	{"mmio_read_user",	NULL,		mmio_read_user_exec,	NULL,		65536,		true},
-	{"mmio_read_vgic",	NULL,		mmio_read_vgic_exec,	NULL,		65536,		true},
-	{"eoi",			NULL,		eoi_exec,		NULL,		65536,		true},
-	{"ipi",			ipi_prep,	ipi_exec,		NULL,		65536,		true},
-	{"ipi_hw",		ipi_hw_prep,	ipi_exec,		NULL,		65536,		true},
-	{"lpi",			lpi_prep,	lpi_exec,		NULL,		65536,		true},
-	{"timer_10ms",		timer_prep,	timer_exec,		timer_post,	256,		true},
+static struct bench tests[] = {
+	BENCH("hvc", hvc_exec),
+	BENCH("mmio_read_user", mmio_read_user_exec, .prep = pci_prep),
+	BENCH("mmio_read_vgic", mmio_read_vgic_exec),
+	BENCH("eoi", eoi_exec),
+	BENCH("ipi", ipi_exec, .prep = ipi_prep),
+	BENCH("ipi_hw", ipi_exec, .prep = ipi_hw_prep),
+	BENCH("lpi", lpi_exec, .prep = lpi_prep),
+	BENCH("timer_10ms", NULL, .prep = timer_prep, .measure = timer_measure),
+	BENCH("pci-mem", NULL, .prep = pci_prep,
+	      .next = pci_bench_mem_write_next),
+	BENCH("pci-io", NULL, .prep = pci_prep,
+	      .next = pci_bench_io_write_next),
+	BENCH("pci-mem-read", NULL, .prep = pci_prep,
+	      .next = pci_bench_mem_read_next),
+	BENCH("pci-io-read", NULL, .prep = pci_prep,
+	      .next = pci_bench_io_read_next),
 };
 
-struct ns_time {
-	uint64_t ns;
-	uint64_t ns_frac;
-};
-
-#define PS_PER_SEC (1000 * 1000 * 1000 * 1000UL)
-static void ticks_to_ns_time(uint64_t ticks, struct ns_time *ns_time)
-{
-	uint64_t ps_per_tick = PS_PER_SEC / cntfrq + !!(PS_PER_SEC % cntfrq);
-	uint64_t ps;
-
-	ps = ticks * ps_per_tick;
-	ns_time->ns = ps / 1000;
-	ns_time->ns_frac = (ps % 1000) / 100;
-}
-
-static void loop_test(struct exit_test *test)
-{
-	uint64_t start, end, total_ticks, ntimes = 0;
-	struct ns_time avg_ns, total_ns = {};
-
-	total_ticks = 0;
-	if (test->prep) {
-		if(!test->prep()) {
-			printf("%s test skipped\n", test->name);
-			return;
-		}
-	}
-
-	while (ntimes < test->times && total_ns.ns < NS_5_SECONDS) {
-		isb();
-		start = read_sysreg(cntpct_el0);
-		test->exec();
-		isb();
-		end = read_sysreg(cntpct_el0);
-
-		ntimes++;
-		total_ticks += (end - start);
-		ticks_to_ns_time(total_ticks, &total_ns);
-	}
-
-	if (test->post) {
-		test->post(ntimes, &total_ticks);
-		ticks_to_ns_time(total_ticks, &total_ns);
-	}
-
-	avg_ns.ns = total_ns.ns / ntimes;
-	avg_ns.ns_frac = total_ns.ns_frac / ntimes;
-
-	printf("%-30s%15" PRId64 ".%-15" PRId64 "%15" PRId64 ".%-15" PRId64 "\n",
-		test->name, total_ns.ns, total_ns.ns_frac, avg_ns.ns, avg_ns.ns_frac);
-}
-
 int main(int argc, char **argv)
 {
-	int i;
-
 	if (!test_init())
 		return 1;
 
-	printf("\n%-30s%18s%13s%18s%13s\n", "name", "total ns", "", "avg ns", "");
-	for (i = 0 ; i < 92; ++i)
-		printf("%c", '-');
-	printf("\n");
-	for (i = 0; i < ARRAY_SIZE(tests); i++) {
-		if (!tests[i].run)
-			continue;
-		assert(tests[i].name && tests[i].exec);
-		loop_test(&tests[i]);
-	}
+	bench_run_all(tests, ARRAY_SIZE(tests), argc - 1, argv + 1);
 
 	return 0;
 }
@@ -18,7 +18,9 @@
 #include "asm/barrier.h"
 #include "asm/sysreg.h"
 #include "asm/processor.h"
+#include <bench.h>
 #include <bitops.h>
+#include <clock.h>
 #include <asm/gic.h>
 
 #define PMU_PMCR_E         (1 << 0)
@@ -155,6 +157,10 @@ static void test_chained_counters(void) {}
 static void test_chained_sw_incr(void) {}
 static void test_chain_promotion(void) {}
 static void test_overflow_interrupt(void) {}
+static void pmu_bench(bool has_pmu, int argc, char **argv)
+{
+	report_skip("PMU benchmarks are only implemented for aarch64");
+}
 
 #elif defined(__aarch64__)
 #define ID_AA64DFR0_PERFMON_SHIFT 8
@@ -865,6 +871,242 @@ static void test_overflow_interrupt(void)
 	report(expect_interrupts(0x2),
 		"expect overflow interrupt on odd counter");
 }
+
+/*
+ * pmu-bench measures what PMU virtualization costs a guest that profiles:
+ * reads of PMCCNTR and of an event counter, writes to an event type
+ * register, to PMCNTENSET/PMCNTENCLR and to PMCR.E, the global enable,
+ * the latency from a counter overflow to the PMU interrupt, and how much
+ * a fixed loop slows down with 0 to N event counters running.  Run it
+ * with the vPMU enabled and disabled (-cpu host,pmu=off); without a vPMU
+ * only the loop runs, as the baseline.  Further arguments select
+ * benchmarks, see bench_run_all().
+ */
+#define BENCH_LOOP_COUNT	1000000
+#define PMI_MAX_MISSES		10
+
+static bool bench_has_pmu;
+static int nr_active = -1;
+static u64 loop_baseline, pmi_ticks, pmi_missed;
+static volatile bool pmi_received;
+static u64 bench_data;
+
+/* PMEVTYPER<n>_EL0 for a variable n */
+static void set_pmevtyper(int n, uint32_t type)
+{
+	write_sysreg(n, pmselr_el0);
+	isb();
+	write_sysreg(type, pmxevtyper_el0);
+}
+
+static void bench_irq_handler(struct pt_regs *regs)
+{
+	uint32_t irqstat = gic_read_iar();
+
+	if (gic_iar_irqnr(irqstat) == PMU_PPI) {
+		pmi_ticks = get_clock_ticks();
+		write_sysreg(ALL_SET, pmovsclr_el0);
+		pmi_received = true;
+	}
+	gic_write_eoir(irqstat);
+}
+
+static bool has_pmu_prep(void)
+{
+	return bench_has_pmu;
+}
+
+static bool has_counters_prep(void)
+{
+	return bench_has_pmu && pmu.nb_implemented_counters;
+}
+
+static void counters_off(struct bench *b)
+{
+	pmu_reset();
+}
+
+static void bench_read_pmccntr(void)
+{
+	(void)get_pmccntr();
+}
+
+static void bench_read_pmevcntr(void)
+{
+	(void)read_regn_el0(pmevcntr, 0);
+}
+
+/* Counter 0 runs, so that KVM has a perf event to reprogram */
+static bool counter0_prep(void)
+{
+	if (!has_counters_prep())
+		return false;
+	pmu_reset();
+	set_pmevtyper(0, CPU_CYCLES | PMEVTYPER_EXCLUDE_EL0);
+	write_sysreg_s(0x1, PMCNTENSET_EL0);
+	set_pmcr(pmu.pmcr_ro | PMU_PMCR_E);
+	return true;
+}
+
+static void bench_write_pmevtyper(void)
+{
+	static bool inst;
+
+	inst = !inst;
+	write_regn_el0(pmevtyper, 0,
+		       (inst ? INST_RETIRED : CPU_CYCLES) | PMEVTYPER_EXCLUDE_EL0);
+}
+
+static void bench_write_pmcntenset(void)
+{
+	static bool cleared;
+
+	cleared = !cleared;
+	if (cleared)
+		write_sysreg_s(0x1, PMCNTENCLR_EL0);
+	else
+		write_sysreg_s(0x1, PMCNTENSET_EL0);
+}
+
+static void bench_write_pmcr(void)
+{
+	static bool cleared;
+
+	cleared = !cleared;
+	set_pmcr(pmu.pmcr_ro | (cleared ? 0 : PMU_PMCR_E));
+}
+
+static bool pmi_prep(void)
+{
+	if (!counter0_prep())
+		return false;
+	set_pmcr(pmu.pmcr_ro);
+	write_sysreg(0x1, pmintenset_el1);
+	isb();
+	gic_enable_irq(PMU_PPI);
+	local_irq_enable();
+	return true;
+}
+
+/*
+ * Event counter 0 counts cycles and starts one cycle before overflowing;
+ * the time is taken from setting PMCR.E to the interrupt handler.
+ * Returns false if the interrupt did not arrive.
+ */
+static bool pmi_latency_once(u64 *t)
+{
+	u64 t0, timeout;
+
+	write_regn_el0(pmevcntr, 0, ALL_SET);
+	pmi_received = false;
+	isb();
+
+	t0 = get_clock_ticks();
+	timeout = t0 + get_clock_hz() / 10;
+	set_pmcr(pmu.pmcr_ro | PMU_PMCR_E);
+	while (!pmi_received && get_clock_ticks() < timeout)
+		cpu_relax();
+	set_pmcr(pmu.pmcr_ro);
+
+	if (!pmi_received)
+		return false;
+	*t = pmi_ticks - t0;
+	return true;
+}
+
+/* A missed interrupt is not a sample, retry it */
+static u64 bench_pmi_latency(void)
+{
+	int misses = 0;
+	u64 t;
+
+	while (!pmi_latency_once(&t)) {
+		pmi_missed++;
+		if (++misses == PMI_MAX_MISSES)
+			report_abort("no PMU interrupt after %d overflows",
+				     misses);
+	}
+	return t;
+}
+
+static void pmi_report(struct bench *b)
+{
+	local_irq_disable();
+	gic_disable_irq(PMU_PPI);
+	pmu_reset();
+}
+
+/* Like mem_access_loop(), without the PMCR accesses */
+static void bench_loop(void)
+{
+	long loop = BENCH_LOOP_COUNT;
+
+	asm volatile(
+	"1:	ldr	x9, [%[addr]]\n"
+	"	subs	%[loop], %[loop], #1\n"
+	"	b.gt	1b\n"
+	: [loop] "+r" (loop)
+	: [addr] "r" (&bench_data)
+	: "x9", "cc");
+}
+
+/* 0, 1, ... event counters running, counting cycles and instructions */
+static bool loop_next(struct bench *b)
+{
+	int i;
+
+	if (bench_has_pmu)
+		pmu_reset();
+
+	if (!bench_next_count(b, &nr_active,
+			      bench_has_pmu ? pmu.nb_implemented_counters : 0))
+		return false;
+
+	if (nr_active) {
+		for (i = 0; i < nr_active; i++)
+			set_pmevtyper(i, (i % 2 ? INST_RETIRED : CPU_CYCLES) |
+					 PMEVTYPER_EXCLUDE_EL0);
+		write_sysreg_s((1UL << nr_active) - 1, PMCNTENSET_EL0);
+		set_pmcr(pmu.pmcr_ro | PMU_PMCR_E);
+	}
+	return true;
+}
+
+static void loop_report(struct bench *b)
+{
+	bench_report_baseline(b, &loop_baseline, !nr_active,
+			      "with no counters");
+}
+
+static struct bench benches[] = {
+	BENCH("read_pmccntr", bench_read_pmccntr, .prep = has_pmu_prep),
+	BENCH("read_pmevcntr", bench_read_pmevcntr, .prep = has_counters_prep),
+	BENCH("write_pmevtyper", bench_write_pmevtyper, .prep = counter0_prep,
+	      .report = counters_off),
+	BENCH("write_pmcntenset", bench_write_pmcntenset, .prep = counter0_prep,
+	      .report = counters_off),
+	BENCH("write_pmcr", bench_write_pmcr, .prep = counter0_prep,
+	      .report = counters_off),
+	{ .name = "pmi_latency", .measure = bench_pmi_latency,
+	  .prep = pmi_prep, .report = pmi_report, .flags = BENCH_SAMPLE },
+	BENCH("loop", bench_loop, .next = loop_next, .report = loop_report),
+};
+
+static void pmu_bench(bool has_pmu, int argc, char **argv)
+{
+	bench_has_pmu = has_pmu;
+	printf("%s, %d event counters%s\n", has_pmu ? "PMU" : "no PMU",
+	       has_pmu ? pmu.nb_implemented_counters : 0,
+	       has_pmu ? "" : ", only the baseline runs");
+
+	gic_enable_defaults();
+	install_irq_handler(EL1H_IRQ, bench_irq_handler);
+
+	bench_run_all(benches, ARRAY_SIZE(benches), argc, argv);
+
+	if (has_counters_prep())
+		report(!pmi_missed, "PMU interrupt after every overflow");
+}
 #endif
 
 /*
@@ -988,13 +1230,16 @@ static void pmccntr64_test(void)
 /* Return FALSE if no PMU found, otherwise return TRUE */
 static bool pmu_probe(void)
 {
-	uint32_t pmcr = get_pmcr();
+	uint32_t pmcr;
 	uint8_t implementer;
 
 	pmu.version = get_pmu_version();
 	if (pmu.version == ID_DFR0_PMU_NOTIMPL || pmu.version == ID_DFR0_PMU_IMPDEF)
 		return false;
 
+	/* PMCR is UNDEFINED without a PMU */
+	pmcr = get_pmcr();
+
 	report_info("PMU version: 0x%x", pmu.version);
 
 	implementer = (pmcr >> PMU_PMCR_IMP_SHIFT) & PMU_PMCR_IMP_MASK;
@@ -1017,6 +1262,12 @@ int main(int argc, char *argv[])
 {
 	int cpi = 0;
 
+	if (argc > 1 && strcmp(argv[1], "pmu-bench") == 0) {
+		report_prefix_push(argv[1]);
+		pmu_bench(pmu_probe(), argc - 2, argv + 2);
+		return report_summary();
+	}
+
 	if (!pmu_probe()) {
 		printf("No PMU found, test skipped...\n");
 		return report_summary();
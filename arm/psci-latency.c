@@ -0,0 +1,370 @@
+/*
+ * PSCI latency benchmark
+ *
+ * CPU_ON/CPU_OFF: the secondaries are cycled through CPU_ON and CPU_OFF,
+ * one at a time and then all together.  CPU_ON starts them in a small
+ * stub that stores the counter at its first instruction and calls
+ * CPU_OFF right away; the boot CPU measures the CPU_ON call, the time to
+ * the first instruction of the target, and the time until AFFINITY_INFO
+ * reports the target off again.
+ *
+ * CPU_SUSPEND: CPU 0 enters a standby power state with interrupts masked
+ * and is woken up by an SGI from CPU 1 or by the virtual timer, after
+ * an idle time of idle_us.  The entry cost is measured by calling
+ * CPU_SUSPEND with an interrupt already pending.
+ *
+ * All results are distributions over the samples; to see how they
+ * change with the number of vCPUs, compare runs with different -smp.
+ *
+ * Usage: psci-latency.flat [samples [idle_us]]
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include <libcflat.h>
+#include <bench.h>
+#include <clock.h>
+#include <asm/barrier.h>
+#include <asm/gic.h>
+#include <asm/io.h>
+#include <asm/page.h>
+#include <asm/processor.h>
+#include <asm/psci.h>
+#include <asm/setup.h>
+#include <asm/smp.h>
+#include <asm/timer.h>
+
+#define WAKE_SGI		1
+#define DEFAULT_SAMPLES		200
+#define MAX_SAMPLES		2000
+#define DEFAULT_IDLE_US		100
+
+/*
+ * Written with the MMU and the caches off by the target, so give each
+ * CPU its own cache line and invalidate it before reading.
+ */
+struct first_insn {
+	u64 cnt;
+} __attribute__((aligned(256)));
+
+static struct first_insn first_insn[NR_CPUS];
+
+extern void cpu_on_stub(void);
+asm(
+"	.pushsection .text\n"
+"	.balign 4\n"
+"	.globl cpu_on_stub\n"
+"cpu_on_stub:\n"
+"	isb\n"
+"	mrs	x1, cntvct_el0\n"
+"	str	x1, [x0]\n"
+"	dsb	sy\n"
+"	ldr	x0, =" xstr(PSCI_0_2_FN_CPU_OFF) "\n"
+"	hvc	#0\n"
+"1:	b	1b\n"
+"	.ltorg\n"
+"	.popsection\n");
+
+static u64 samples_a[MAX_SAMPLES], samples_b[MAX_SAMPLES], samples_c[MAX_SAMPLES];
+static u64 timeout;
+
+static volatile bool woken, sender_stop, sender_ready;
+static volatile u64 rx_cnt, send_cnt, halt_cnt, idle_ticks;
+static volatile unsigned int halt_seq;
+
+static void print_dist(const char *name, u64 *v, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		v[i] = (s64)v[i] > 0 ? clock_ticks_to_ns(v[i]) : 0;
+	printf("%-24s", name);
+	bench_print_percentiles(v, n);
+}
+
+static u64 read_first_insn(int cpu)
+{
+	asm volatile("dc civac, %0" : : "r" (&first_insn[cpu]) : "memory");
+	dsb(sy);
+	return *(volatile u64 *)&first_insn[cpu].cnt;
+}
+
+static void clear_first_insn(int cpu)
+{
+	first_insn[cpu].cnt = 0;
+	asm volatile("dc civac, %0" : : "r" (&first_insn[cpu]) : "memory");
+	dsb(sy);
+}
+
+static int cpu_on_stub_call(int cpu)
+{
+	return psci_invoke(PSCI_0_2_FN64_CPU_ON, cpus[cpu], __pa(cpu_on_stub),
+			   __pa(&first_insn[cpu]));
+}
+
+static bool wait_first_insn(int cpu, u64 *cnt)
+{
+	u64 t0 = get_cntvct();
+
+	while (!(*cnt = read_first_insn(cpu)))
+		if (get_cntvct() - t0 > timeout)
+			return false;
+	return true;
+}
+
+static bool wait_off(int cpu)
+{
+	u64 t0 = get_cntvct();
+
+	while (psci_invoke(PSCI_0_2_FN64_AFFINITY_INFO, cpus[cpu], 0, 0) !=
+	       PSCI_0_2_AFFINITY_LEVEL_OFF)
+		if (get_cntvct() - t0 > timeout)
+			return false;
+	return true;
+}
+
+/* CPU_ON, first instruction and CPU_OFF of one secondary at a time */
+static bool cpu_on_off_serial(int samples)
+{
+	u64 t0, t1, first;
+	char name[24];
+	int cpu, n;
+
+	for_each_present_cpu(cpu) {
+		if (cpu == 0)
+			continue;
+		for (n = 0; n < samples; n++) {
+			clear_first_insn(cpu);
+			t0 = get_cntvct();
+			if (cpu_on_stub_call(cpu) != PSCI_RET_SUCCESS)
+				return false;
+			t1 = get_cntvct();
+			if (!wait_first_insn(cpu, &first) || !wait_off(cpu))
+				return false;
+			samples_a[n] = t1 - t0;
+			samples_b[n] = first - t0;
+			samples_c[n] = get_cntvct() - first;
+		}
+		snprintf(name, sizeof(name), "cpu%d cpu_on call", cpu);
+		print_dist(name, samples_a, samples);
+		snprintf(name, sizeof(name), "cpu%d first insn", cpu);
+		print_dist(name, samples_b, samples);
+		snprintf(name, sizeof(name), "cpu%d cpu_off", cpu);
+		print_dist(name, samples_c, samples);
+	}
+	return true;
+}
+
+/* CPU_ON all secondaries back to back, until the last one is running */
+static bool cpu_on_off_all(int samples)
+{
+	u64 t0, first, last;
+	int cpu, n;
+
+	for (n = 0; n < samples; n++) {
+		for_each_present_cpu(cpu)
+			if (cpu != 0)
+				clear_first_insn(cpu);
+		t0 = get_cntvct();
+		for_each_present_cpu(cpu)
+			if (cpu != 0 && cpu_on_stub_call(cpu) != PSCI_RET_SUCCESS)
+				return false;
+		samples_a[n] = get_cntvct() - t0;
+		last = t0;
+		for_each_present_cpu(cpu) {
+			if (cpu == 0)
+				continue;
+			if (!wait_first_insn(cpu, &first))
+				return false;
+			last = MAX(last, first);
+		}
+		samples_b[n] = last - t0;
+		for_each_present_cpu(cpu)
+			if (cpu != 0 && !wait_off(cpu))
+				return false;
+	}
+	print_dist("all cpu_on calls", samples_a, samples);
+	print_dist("all first insn", samples_b, samples);
+	return true;
+}
+
+static int cpu_suspend_standby(void)
+{
+	/* Power state 0: standby, which returns like WFI */
+	return psci_invoke(PSCI_0_2_FN64_CPU_SUSPEND, 0, 0, 0);
+}
+
+static void wake_handler(struct pt_regs *regs)
+{
+	u32 irqstat = gic_read_iar();
+	u32 irqnr = gic_iar_irqnr(irqstat);
+
+	rx_cnt = get_cntvct();
+	if (irqnr == GICC_INT_SPURIOUS)
+		return;
+	if (irqnr == PPI(TIMER_VTIMER_IRQ)) {
+		write_sysreg(ARCH_TIMER_CTL_IMASK | ARCH_TIMER_CTL_ENABLE,
+			     cntv_ctl_el0);
+		isb();
+	}
+	gic_write_eoir(irqstat);
+	woken = true;
+}
+
+static void wait_for_wakeup(void)
+{
+	while (!woken) {
+		/* A pending interrupt ends the standby state even when masked */
+		cpu_suspend_standby();
+		local_irq_enable();
+		local_irq_disable();
+	}
+}
+
+/* Runs on CPU 1: send an SGI once CPU 0 has been suspended for idle_ticks. */
+static void sgi_sender(void *data)
+{
+	unsigned int seq = halt_seq;
+	u64 t;
+
+	gic_enable_defaults();
+	sender_ready = true;
+	while (!sender_stop) {
+		if (halt_seq == seq) {
+			cpu_relax();
+			continue;
+		}
+		seq = halt_seq;
+		smp_rmb();
+		t = halt_cnt + idle_ticks;
+		while (get_cntvct() < t)
+			cpu_relax();
+		send_cnt = get_cntvct();
+		gic_ipi_send_single(WAKE_SGI, 0);
+	}
+	sender_ready = false;
+}
+
+static bool suspend_entry(int samples)
+{
+	u64 t0;
+	int n, ret;
+
+	local_irq_disable();
+	for (n = 0; n < samples; n++) {
+		/* Make the timer interrupt pending, but do not take it */
+		write_sysreg(0, cntv_cval_el0);
+		write_sysreg(ARCH_TIMER_CTL_ENABLE, cntv_ctl_el0);
+		isb();
+		t0 = get_cntvct();
+		ret = cpu_suspend_standby();
+		samples_a[n] = get_cntvct() - t0;
+		write_sysreg(0, cntv_ctl_el0);
+		isb();
+		if (ret != PSCI_RET_SUCCESS)
+			return false;
+	}
+	print_dist("suspend pending", samples_a, samples);
+	return true;
+}
+
+static void suspend_sgi(int samples)
+{
+	int n;
+
+	for (n = 0; n < samples; n++) {
+		local_irq_disable();
+		woken = false;
+		halt_cnt = get_cntvct();
+		smp_wmb();
+		halt_seq++;
+		wait_for_wakeup();
+		samples_a[n] = rx_cnt - send_cnt;
+	}
+	print_dist("suspend sgi wake-up", samples_a, samples);
+}
+
+static void suspend_timer(int samples)
+{
+	u64 deadline;
+	int n;
+
+	for (n = 0; n < samples; n++) {
+		local_irq_disable();
+		woken = false;
+		deadline = get_cntvct() + idle_ticks;
+		write_sysreg(deadline, cntv_cval_el0);
+		write_sysreg(ARCH_TIMER_CTL_ENABLE, cntv_ctl_el0);
+		isb();
+		wait_for_wakeup();
+		samples_a[n] = rx_cnt - deadline;
+	}
+	write_sysreg(0, cntv_ctl_el0);
+	isb();
+	print_dist("suspend timer wake-up", samples_a, samples);
+}
+
+int main(int argc, char **argv)
+{
+	int samples = argc > 1 ? atol(argv[1]) : DEFAULT_SAMPLES;
+	u64 idle_us = argc > 2 ? atol(argv[2]) : DEFAULT_IDLE_US;
+	void *gic_isenabler;
+
+	samples = MAX(1, MIN(samples, MAX_SAMPLES));
+	timeout = get_clock_hz();
+	idle_ticks = get_clock_hz() * idle_us / 1000000;
+
+	printf("%d CPUs, %d samples, idle time %" PRIu64 " us, latency in ns\n",
+	       nr_cpus, samples, idle_us);
+	printf("%-24s", "event");
+	bench_print_percentiles_header();
+
+	if (nr_cpus > 1) {
+		/* Before anything else boots the secondaries */
+		report(cpu_on_off_serial(samples), "CPU_ON/CPU_OFF, one CPU at a time");
+		report(cpu_on_off_all(samples), "CPU_ON/CPU_OFF, all CPUs");
+	} else {
+		report_skip("CPU_ON/CPU_OFF needs at least two CPUs");
+	}
+
+	if (!gic_init()) {
+		report_skip("No supported gic present");
+		return report_summary();
+	}
+	gic_enable_defaults();
+	install_irq_handler(EL1H_IRQ, wake_handler);
+	switch (gic_version()) {
+	case 2:
+		gic_isenabler = gicv2_dist_base() + GICD_ISENABLER;
+		break;
+	case 3:
+		gic_isenabler = gicv3_sgi_base() + GICR_ISENABLER0;
+		break;
+	default:
+		assert_msg(0, "Unreachable");
+	}
+	writel(1 << PPI(TIMER_VTIMER_IRQ), gic_isenabler);
+
+	if (!suspend_entry(samples)) {
+		report_skip("CPU_SUSPEND not supported");
+		return report_summary();
+	}
+	report(true, "CPU_SUSPEND entry");
+
+	if (nr_cpus > 1) {
+		on_cpu_async(1, sgi_sender, NULL);
+		while (!sender_ready)
+			cpu_relax();
+		suspend_sgi(samples);
+		sender_stop = true;
+		while (sender_ready)
+			cpu_relax();
+		report(true, "CPU_SUSPEND wake-up by SGI");
+	} else {
+		report_skip("SGI wake-up needs at least two CPUs");
+	}
+
+	suspend_timer(samples);
+	report(true, "CPU_SUSPEND wake-up by timer");
+
+	return report_summary();
+}
@@ -0,0 +1,91 @@
+/*
+ * vCPU bring-up benchmark
+ *
+ * Boots the secondaries one at a time with smp_boot_secondary(), like
+ * on_cpu() does on first use, and reports the timestamps it records:
+ * the PSCI CPU_ON call, the first C code of the secondary, the boot CPU
+ * seeing it online, and the secondary running its entry function.  From
+ * these, it prints how long it took for the first N secondaries to be
+ * ready, for N up to the number of CPUs of the guest.  To see how it
+ * scales, compare runs with -smp from 1 to the maximum of the host.
+ *
+ * Usage: smp-boot.flat [-v]
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include <libcflat.h>
+#include <clock.h>
+#include <asm/processor.h>
+#include <asm/setup.h>
+#include <asm/smp.h>
+
+static volatile u64 ready[NR_CPUS];
+
+static u64 ticks_to_us(u64 ticks)
+{
+	return clock_ticks_to_ns(ticks) / 1000;
+}
+
+static void ready_entry(void)
+{
+	ready[smp_processor_id()] = get_cntvct();
+	do_idle();
+}
+
+int main(int argc, char **argv)
+{
+	bool verbose = argc > 1 && !strcmp(argv[1], "-v");
+	struct secondary_boot_times *t;
+	u64 start, cpu_on = 0, cinit = 0, online = 0, total;
+	int cpu, n = 0, next = 1;
+	bool ok = true;
+
+	printf("%d CPUs, counter at %" PRIu64 " Hz\n", nr_cpus,
+	       (u64)get_clock_hz());
+	if (nr_cpus < 2) {
+		report_skip("no secondaries");
+		return report_summary();
+	}
+
+	printf("%6s %12s\n", "CPUs", "ready us");
+	start = get_cntvct();
+	for_each_present_cpu(cpu) {
+		if (cpu == 0)
+			continue;
+		assert(!cpu_online(cpu));
+		smp_boot_secondary(cpu, ready_entry);
+		while (!ready[cpu])
+			cpu_relax();
+
+		t = &secondary_boot_times[cpu];
+		ok &= t->cpu_on <= t->cpu_on_ret && t->cpu_on <= t->cinit &&
+		      t->cinit <= t->online && t->cinit <= ready[cpu];
+		cpu_on += t->cpu_on_ret - t->cpu_on;
+		cinit += t->cinit - t->cpu_on;
+		online += t->online - t->cpu_on;
+		if (verbose)
+			printf("cpu%d: CPU_ON %" PRIu64 " us, C code at %" PRIu64
+			       " us, online at %" PRIu64 " us, ready at %" PRIu64
+			       " us\n", cpu, ticks_to_us(t->cpu_on_ret - t->cpu_on),
+			       ticks_to_us(t->cinit - t->cpu_on),
+			       ticks_to_us(t->online - t->cpu_on),
+			       ticks_to_us(ready[cpu] - t->cpu_on));
+
+		/* Time until the first n secondaries were ready */
+		if (++n == next || n == nr_cpus - 1) {
+			printf("%6d %12" PRIu64 "\n", n,
+			       ticks_to_us(ready[cpu] - start));
+			next *= 2;
+		}
+	}
+	total = get_cntvct() - start;
+	report(ok, "timestamps for %d secondaries", n);
+
+	printf("bring-up: %d secondaries ready in %" PRIu64 " us (%" PRIu64
+	       " ns each: CPU_ON %" PRIu64 " ns, C code after %" PRIu64
+	       " ns, online after %" PRIu64 " ns)\n", n, ticks_to_us(total),
+	       clock_ticks_to_ns(total) / n, clock_ticks_to_ns(cpu_on) / n,
+	       clock_ticks_to_ns(cinit) / n, clock_ticks_to_ns(online) / n);
+
+	return report_summary();
+}
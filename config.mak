@@ -0,0 +1,22 @@
+SRCDIR=/root/repo
+PREFIX=/usr/local
+HOST=x86_64
+ARCH=x86_64
+ARCH_NAME=x86_64
+PROCESSOR=x86_64
+CC=gcc
+LD=ld
+OBJCOPY=objcopy
+OBJDUMP=objdump
+AR=ar
+ADDR2LINE=addr2line
+TEST_DIR=x86
+FIRMWARE=
+ENDIAN=
+PRETTY_PRINT_STACKS=yes
+ENVIRON_DEFAULT=yes
+ERRATATXT=/root/repo/errata.txt
+U32_LONG_FMT=
+WA_DIVIDE=
+GENPROTIMG=genprotimg
+HOST_KEY_DOCUMENT=
@@ -270,6 +270,23 @@ void free_pages(void *mem)
 	spin_unlock(&lock);
 }
 
+unsigned int get_block_order(void *mem)
+{
+	uintptr_t pfn = PFN(mem);
+	struct mem_area *a;
+	u8 state;
+
+	spin_lock(&lock);
+	a = get_area(pfn);
+	assert_msg(a, "memory does not belong to any area: %p", mem);
+	state = a->page_states[pfn - a->base];
+	spin_unlock(&lock);
+
+	assert(state & ALLOC_MASK);
+	assert(IS_ALIGNED_ORDER(pfn, state & ORDER_MASK));
+	return state & ORDER_MASK;
+}
+
 static void *_alloc_page_special(uintptr_t addr)
 {
 	struct mem_area *a;
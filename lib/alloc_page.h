@@ -63,6 +63,12 @@ void *alloc_pages(unsigned int order);
  */
 void free_pages(void *mem);
 
+/*
+ * Returns the order of the allocated block starting at mem.
+ * The pointer must point to the start of the block.
+ */
+unsigned int get_block_order(void *mem);
+
 /* For backwards compatibility */
 static inline void free_page(void *mem)
 {
@@ -61,6 +61,9 @@
 #define LPI_PROP_DEFAULT		(LPI_PROP_DEFAULT_PRIO | LPI_PROP_GROUP1 | LPI_PROP_ENABLED)
 
 #define LPI_ID_BASE			8192
+/* INTID bits in PROPBASER, the 64K tables have room for 16 */
+#define LPI_ID_BITS			16
+#define LPI_NR				((1 << LPI_ID_BITS) - LPI_ID_BASE)
 #define LPI(lpi)			((lpi) + LPI_ID_BASE)
 #define LPI_OFFSET(intid)		((intid) - LPI_ID_BASE)
 
@@ -50,6 +50,16 @@ static inline void set_cpu_idle(int cpu, bool idle)
 
 typedef void (*secondary_entry_fn)(void);
 extern void smp_boot_secondary(int cpu, secondary_entry_fn entry);
+
+/*
+ * Counter values recorded by smp_boot_secondary(): before and after the
+ * PSCI CPU_ON call, when the secondary reaches C code, and when the boot
+ * CPU sees it online.
+ */
+struct secondary_boot_times {
+	u64 cpu_on, cpu_on_ret, cinit, online;
+};
+extern struct secondary_boot_times secondary_boot_times[];
 extern void on_cpu_async(int cpu, void (*func)(void *data), void *data);
 extern void on_cpu(int cpu, void (*func)(void *data), void *data);
 extern void on_cpus(void (*func)(void *data), void *data);
@@ -0,0 +1,22 @@
+#ifndef _ASMARM_TIME_H_
+#define _ASMARM_TIME_H_
+/*
+ * Clock used for timing measurements: the virtual counter
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include <libcflat.h>
+#include <asm/processor.h>
+
+static inline u64 get_clock_ticks(void)
+{
+	return get_cntvct();
+}
+
+/* Frequency of get_clock_ticks() in Hz */
+static inline u64 get_clock_hz(void)
+{
+	return get_cntfrq();
+}
+
+#endif /* _ASMARM_TIME_H_ */
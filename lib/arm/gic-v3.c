@@ -169,8 +169,7 @@ void gicv3_lpi_alloc_tables(void)
 
 	gicv3_data.lpi_prop = alloc_pages(order);
 
-	/* ID bits = 13, ie. up to 14b LPI INTID */
-	prop_val = (u64)(virt_to_phys(gicv3_data.lpi_prop)) | 13;
+	prop_val = (u64)(virt_to_phys(gicv3_data.lpi_prop)) | (LPI_ID_BITS - 1);
 
 	for_each_present_cpu(cpu) {
 		u64 pend_val;
@@ -101,19 +101,13 @@ static int do_getchar(void)
 /*
  * Minimalist implementation for migration completion detection.
  * Without FIFOs enabled on the QEMU UART device we just read
- * the data register: we cannot read more than 16 characters.
+ * the data register, which holds one character at a time.  Each
+ * migration consumes a character, so there is no limit on their
+ * number.
  */
 int __getchar(void)
 {
-	int c = do_getchar();
-	static int count;
-
-	if (c != -1)
-		++count;
-
-	assert(count < 16);
-
-	return c;
+	return do_getchar();
 }
 
 /*
@@ -125,7 +119,12 @@ extern void halt(int code);
 
 void exit(int code)
 {
-	chr_testdev_exit(code);
+	/*
+	 * Without chr-testdev, e.g. with kvmtool, the runner takes the
+	 * status from this line, in the same format as powerpc and s390x.
+	 */
+	if (!chr_testdev_exit(code))
+		printf("\nEXIT: STATUS=%d\n", ((code) << 1) | 1);
 	psci_system_off();
 	halt(code);
 	__builtin_unreachable();
@@ -112,10 +112,69 @@ pteval_t *install_page(pgd_t *pgtable, phys_addr_t phys, void *virt)
 				 __pgprot(PTE_WBWA | PTE_USER));
 }
 
+/*
+ * Map [phys, phys + len) at virt, filling each page table in one pass and
+ * using section mappings where allowed; a single TLB flush is done at the
+ * end, rather than one per page.
+ */
+void install_range(pgd_t *pgtable, phys_addr_t phys, void *virt, size_t len,
+		   bool large)
+{
+	pteval_t prot = PTE_WBWA | PTE_USER;
+	uintptr_t vaddr = (uintptr_t)virt;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+	pte_t *pte;
+
+	assert(IS_ALIGNED(phys | vaddr | len, PAGE_SIZE));
+
+	while (len) {
+		pgd = pgd_offset(pgtable, vaddr);
+		pud = pud_alloc(pgd, vaddr);
+		pmd = pmd_alloc(pud, vaddr);
+
+		if (large && len >= PMD_SIZE && IS_ALIGNED(phys | vaddr, PMD_SIZE)) {
+			do {
+				pmd_t entry;
+
+				pmd_val(entry) = phys | PMD_TYPE_SECT |
+						 PMD_SECT_AF | PMD_SECT_S | prot;
+				WRITE_ONCE(*pmd, entry);
+				pmd++;
+				phys += PMD_SIZE;
+				vaddr += PMD_SIZE;
+				len -= PMD_SIZE;
+			} while (len >= PMD_SIZE && !IS_ALIGNED(vaddr, PUD_SIZE));
+			continue;
+		}
+
+		pte = pte_alloc(pmd, vaddr);
+		do {
+			WRITE_ONCE(pte_val(*pte), phys | PTE_TYPE_PAGE |
+				   PTE_AF | PTE_SHARED | prot);
+			pte++;
+			phys += PAGE_SIZE;
+			vaddr += PAGE_SIZE;
+			len -= PAGE_SIZE;
+		} while (len && !IS_ALIGNED(vaddr, PMD_SIZE));
+	}
+	flush_tlb_all();
+}
+
 phys_addr_t virt_to_pte_phys(pgd_t *pgtable, void *mem)
 {
-	return (*get_pte(pgtable, (uintptr_t)mem) & PHYS_MASK & -PAGE_SIZE)
-		+ ((ulong)mem & (PAGE_SIZE - 1));
+	uintptr_t vaddr = (uintptr_t)mem;
+	pgd_t *pgd = pgd_offset(pgtable, vaddr);
+	pud_t *pud = pud_alloc(pgd, vaddr);
+	pmd_t *pmd = pmd_alloc(pud, vaddr);
+
+	if (pmd_huge(*pmd))
+		return (pmd_val(*pmd) & PHYS_MASK & PMD_MASK)
+			+ (vaddr & ~PMD_MASK);
+
+	return (*get_pte(pgtable, vaddr) & PHYS_MASK & -PAGE_SIZE)
+		+ (vaddr & (PAGE_SIZE - 1));
 }
 
 void mmu_set_range_ptes(pgd_t *pgtable, uintptr_t virt_offset,
@@ -7,12 +7,15 @@
  */
 #include <libcflat.h>
 #include <auxinfo.h>
+#include <bench.h>
 #include <asm/thread_info.h>
 #include <asm/spinlock.h>
 #include <asm/cpumask.h>
 #include <asm/barrier.h>
 #include <asm/mmu.h>
+#include <asm/processor.h>
 #include <asm/psci.h>
+#include <asm/setup.h>
 #include <asm/smp.h>
 
 bool cpu0_calls_idle;
@@ -26,6 +29,7 @@ struct secondary_data {
 	secondary_entry_fn entry;
 };
 struct secondary_data secondary_data;
+struct secondary_boot_times secondary_boot_times[NR_CPUS];
 static struct spinlock lock;
 
 /* Needed to compile with -Wmissing-prototypes */
@@ -35,8 +39,10 @@ secondary_entry_fn secondary_cinit(void)
 {
 	struct thread_info *ti = current_thread_info();
 	secondary_entry_fn entry;
+	u64 cinit = get_cntvct();
 
 	thread_info_init(ti, 0);
+	secondary_boot_times[ti->cpu].cinit = cinit;
 
 	if (!(auxinfo.flags & AUXINFO_MMU_OFF)) {
 		ti->pgtable = mmu_idmap;
@@ -65,11 +71,14 @@ static void __smp_boot_secondary(int cpu, secondary_entry_fn entry)
 	secondary_data.stack = thread_stack_alloc();
 	secondary_data.entry = entry;
 	mmu_mark_disabled(cpu);
+	secondary_boot_times[cpu].cpu_on = get_cntvct();
 	ret = cpu_psci_cpu_boot(cpu);
+	secondary_boot_times[cpu].cpu_on_ret = get_cntvct();
 	assert(ret == 0);
 
 	while (!cpu_online(cpu))
 		wfe();
+	secondary_boot_times[cpu].online = get_cntvct();
 }
 
 void smp_boot_secondary(int cpu, secondary_entry_fn entry)
@@ -209,3 +218,14 @@ void on_cpus(void (*func)(void *data), void *data)
 	for_each_present_cpu(cpu)
 		cpumask_clear_cpu(me, &on_cpu_info[cpu].waiters);
 }
+
+/* SMP hooks for the benchmark harness */
+int bench_nr_cpus(void)
+{
+	return nr_cpus;
+}
+
+void bench_on_cpus(void (*func)(void *data), void *data)
+{
+	on_cpus(func, data);
+}
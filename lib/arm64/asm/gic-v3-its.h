@@ -31,15 +31,19 @@ struct its_baser {
 };
 
 #define GITS_BASER_NR_REGS		8
-#define GITS_MAX_DEVICES		8
+/* As many as the flat 64K device table holds with 8-byte entries */
+#define GITS_MAX_DEVICES		8192
 #define GITS_MAX_COLLECTIONS		8
 
 struct its_device {
 	u32 device_id;	/* device ID */
-	u32 nr_ites;	/* Max Interrupt Translation Entries */
+	u32 nr_ites;	/* Number of Interrupt Translation Entries */
 	void *itt;	/* Interrupt Translation Table GVA */
 };
 
+/* MAPD gives the ITT size in EventID bits, at least one */
+#define its_eventid_bits(dev)		MAX(get_order((dev)->nr_ites), 1U)
+
 struct its_collection {
 	u64 target_address;
 	u16 col_id;
@@ -0,0 +1 @@
+#include "../../arm/asm/time.h"
@@ -211,7 +211,7 @@ static void its_build_mapd_cmd(struct its_cmd_block *cmd,
 			       struct its_cmd_desc *desc)
 {
 	unsigned long itt_addr;
-	u8 size = desc->its_mapd_cmd.dev->nr_ites;
+	u8 size = its_eventid_bits(desc->its_mapd_cmd.dev);
 
 	itt_addr = (unsigned long)(virt_to_phys(desc->its_mapd_cmd.dev->itt));
 	itt_addr = ALIGN(itt_addr, ITS_ITT_ALIGN);
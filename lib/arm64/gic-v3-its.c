@@ -110,10 +110,34 @@ void its_enable_defaults(void)
 	writel(GITS_CTLR_ENABLE, its_data.base + GITS_CTLR);
 }
 
+/*
+ * ITTs only need 256-byte alignment; carve them out of 64K chunks so
+ * that thousands of devices with a few events each do not take a page
+ * each.  ITTs are never freed.
+ */
+static void *its_alloc_itt(size_t size)
+{
+	static void *chunk;
+	static size_t left;
+	void *itt;
+
+	size = ALIGN(size, SZ_256);
+	if (size > left) {
+		left = PAGE_ALIGN(MAX(size, (size_t)SZ_64K));
+		chunk = alloc_pages(get_order(left >> PAGE_SHIFT));
+		/* KVM restores any nonzero entry, even one it did not save */
+		memset(chunk, 0, left);
+	}
+
+	itt = chunk;
+	chunk += size;
+	left -= size;
+	return itt;
+}
+
 struct its_device *its_create_device(u32 device_id, int nr_ites)
 {
 	struct its_device *new;
-	unsigned long n;
 
 	assert(its_data.nr_devices < GITS_MAX_DEVICES);
 
@@ -122,8 +146,7 @@ struct its_device *its_create_device(u32 device_id, int nr_ites)
 	new->device_id = device_id;
 	new->nr_ites = nr_ites;
 
-	n = (its_data.typer.ite_size * nr_ites) >> PAGE_SHIFT;
-	new->itt = alloc_pages(get_order(n));
+	new->itt = its_alloc_itt(its_data.typer.ite_size << its_eventid_bits(new));
 
 	its_data.nr_devices++;
 	return new;
@@ -152,7 +175,7 @@ struct its_device *its_get_device(u32 id)
 {
 	int i;
 
-	for (i = 0; i < GITS_MAX_DEVICES; i++) {
+	for (i = 0; i < its_data.nr_devices; i++) {
 		if (its_data.devices[i].device_id == id)
 			return &its_data.devices[i];
 	}
@@ -0,0 +1,250 @@
+/*
+ * Common harness for micro-benchmarks
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include <libcflat.h>
+#include <bench.h>
+#include <clock.h>
+
+struct bench_batch {
+	struct bench *b;
+	struct bench_result res;
+	/* wall clock time of the batch, including the SMP overhead */
+	u64 wall;
+};
+
+int __attribute__((__weak__)) bench_nr_cpus(void)
+{
+	return 1;
+}
+
+void __attribute__((__weak__)) bench_on_cpus(void (*func)(void *data),
+					     void *data)
+{
+	func(data);
+}
+
+static void run_timed(void *data)
+{
+	struct bench_batch *batch = data;
+	struct bench *b = batch->b;
+	u64 i, t0, t;
+
+	if (!b->measure && !(b->flags & BENCH_SAMPLE)) {
+		t0 = get_clock_ticks();
+		for (i = 0; i < batch->res.iterations; i++)
+			b->exec();
+		batch->res.ticks = get_clock_ticks() - t0;
+		return;
+	}
+
+	batch->res.ticks = batch->res.max = 0;
+	batch->res.min = -1ULL;
+	for (i = 0; i < batch->res.iterations; i++) {
+		if (b->measure) {
+			t = b->measure();
+		} else {
+			t0 = get_clock_ticks();
+			b->exec();
+			t = get_clock_ticks() - t0;
+		}
+		batch->res.ticks += t;
+		batch->res.min = MIN(batch->res.min, t);
+		batch->res.max = MAX(batch->res.max, t);
+	}
+}
+
+static void run_untimed(void *data)
+{
+	struct bench_batch *batch = data;
+	u64 i;
+
+	for (i = 0; i < batch->res.iterations; i++)
+		batch->b->exec();
+}
+
+static void run_batch(struct bench_batch *batch)
+{
+	u64 t0 = get_clock_ticks();
+
+	if (batch->b->flags & BENCH_PARALLEL)
+		bench_on_cpus(run_untimed, batch);
+	else
+		run_timed(batch);
+	batch->wall = get_clock_ticks() - t0;
+
+	if (batch->b->flags & BENCH_PARALLEL)
+		batch->res.ticks = batch->wall;
+}
+
+static void run_adaptive(struct bench *b, const char *name)
+{
+	struct bench_batch batch = { .b = b };
+	u64 goal = get_clock_hz() * BENCH_GOAL_MS / 1000;
+	u64 max = b->max_iterations ? b->max_iterations : -1ULL;
+
+	/* Warm up caches, TLBs and whatever the host does lazily */
+	batch.res.iterations = MIN(BENCH_WARMUP, max);
+	run_batch(&batch);
+
+	batch.res.iterations = 1;
+	for (;;) {
+		run_batch(&batch);
+		if (batch.wall >= goal || batch.res.iterations >= max)
+			break;
+		batch.res.iterations = MIN(batch.res.iterations * 2, max);
+	}
+
+	b->result = batch.res;
+	bench_print(name, &batch.res);
+}
+
+static void print_ns(u64 ticks, u64 count)
+{
+	u64 ns10 = clock_ticks_to_ns(ticks * 10) / count;
+
+	printf(" %10" PRIu64 ".%" PRIu64, ns10 / 10, ns10 % 10);
+}
+
+void bench_print(const char *name, struct bench_result *res)
+{
+	if (!res->iterations) {
+		printf("%-32s (no iterations)\n", name);
+		return;
+	}
+
+	printf("%-32s %10" PRIu64 " %10" PRIu64, name, res->iterations,
+	       res->ticks / res->iterations);
+	print_ns(res->ticks, res->iterations);
+	if (res->max) {
+		print_ns(res->min, 1);
+		print_ns(res->max, 1);
+	}
+	printf("\n");
+}
+
+/* Insertion sort, the number of samples is small */
+void bench_sort(u64 *v, int n)
+{
+	int i, j;
+	u64 x;
+
+	for (i = 1; i < n; i++) {
+		x = v[i];
+		for (j = i; j > 0 && v[j - 1] > x; j--)
+			v[j] = v[j - 1];
+		v[j] = x;
+	}
+}
+
+void bench_print_percentiles(u64 *v, int n)
+{
+	assert(n > 0);
+	bench_sort(v, n);
+	printf(" %8" PRIu64 " %8" PRIu64 " %8" PRIu64 " %8" PRIu64
+	       " %8" PRIu64 "\n", v[0], v[n / 2], v[n * 9 / 10],
+	       v[n * 99 / 100], v[n - 1]);
+}
+
+void bench_print_percentiles_header(void)
+{
+	printf(" %8s %8s %8s %8s %8s\n", "min", "p50", "p90", "p99", "max");
+}
+
+bool bench_next_count(struct bench *b, int *nr, int max)
+{
+	static char variant[16];
+
+	if (*nr >= max) {
+		*nr = -1;
+		return false;
+	}
+
+	(*nr)++;
+	snprintf(variant, sizeof(variant), "%d", *nr);
+	b->variant = variant;
+	return true;
+}
+
+void bench_report_baseline(struct bench *b, u64 *baseline, bool is_baseline,
+			   const char *what)
+{
+	u64 t = b->result.ticks / b->result.iterations;
+	u64 permille;
+
+	if (is_baseline) {
+		*baseline = t;
+		return;
+	}
+	if (!*baseline)
+		return;
+
+	permille = (t > *baseline ? t - *baseline : *baseline - t) *
+		   1000 / *baseline;
+	printf("  %s%" PRIu64 ".%" PRIu64 "%% slower than %s\n",
+	       t < *baseline ? "-" : "", permille / 10, permille % 10, what);
+}
+
+bool bench_run(struct bench *b)
+{
+	char name[64];
+
+	assert(!(b->flags & BENCH_PARALLEL) ||
+	       !(b->measure || (b->flags & BENCH_SAMPLE)));
+
+	if (b->prep && !b->prep()) {
+		printf("%-32s (skipped)\n", b->name);
+		return false;
+	}
+
+	do {
+		if (b->next && !b->next(b))
+			break;
+		assert(!!b->exec != !!b->measure);
+
+		if (b->variant)
+			snprintf(name, sizeof(name), "%s:%s", b->name, b->variant);
+		else
+			snprintf(name, sizeof(name), "%s", b->name);
+
+		run_adaptive(b, name);
+
+		if (b->report)
+			b->report(b);
+	} while (b->next);
+
+	return true;
+}
+
+static bool bench_wanted(const char *name, int argc, char **argv)
+{
+	bool positive = false, match = false;
+	int i;
+
+	for (i = 0; i < argc; i++) {
+		if (argv[i][0] == '-') {
+			if (simple_glob(name, argv[i] + 1))
+				return false;
+		} else {
+			positive = true;
+			match |= simple_glob(name, argv[i]);
+		}
+	}
+
+	return !positive || match;
+}
+
+void bench_run_all(struct bench *benches, int nr, int argc, char **argv)
+{
+	int i;
+
+	printf("clock: %" PRIu64 " Hz, %d CPUs\n", (u64)get_clock_hz(),
+	       bench_nr_cpus());
+	printf("%-32s %10s %10s %12s %12s %12s\n", "name", "iterations",
+	       "ticks/op", "ns/op", "min ns", "max ns");
+
+	for (i = 0; i < nr; i++)
+		if (bench_wanted(benches[i].name, argc, argv))
+			bench_run(&benches[i]);
+}
@@ -0,0 +1,101 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+/*
+ * Common harness for micro-benchmarks
+ *
+ * A test lists its benchmarks in an array of struct bench, usually built
+ * with BENCH(), and runs them with bench_run_all().  For each benchmark
+ * the harness does a warm-up, then times batches of iterations with the
+ * clock from asm/time.h, doubling the batch size until a batch takes at
+ * least BENCH_GOAL_MS, and prints the cost of one iteration in clock
+ * ticks and in nanoseconds, in the same format on all architectures.
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include <libcflat.h>
+
+#define BENCH_GOAL_MS		200
+#define BENCH_WARMUP		32
+
+/* Run exec() on all CPUs at the same time and report the wall clock time */
+#define BENCH_PARALLEL		(1 << 0)
+/* Time every iteration separately, to also report the min and max */
+#define BENCH_SAMPLE		(1 << 1)
+
+struct bench_result {
+	u64 iterations;
+	u64 ticks;
+	/* Only with BENCH_SAMPLE or measure, otherwise 0 */
+	u64 min, max;
+};
+
+struct bench {
+	const char *name;
+	/* Optional; returns false if the benchmark cannot run */
+	bool (*prep)(void);
+	/* One iteration, timed by the harness */
+	void (*exec)(void);
+	/* Instead of exec: one iteration, returns its own cost in ticks */
+	u64 (*measure)(void);
+	/*
+	 * Optional; prints additional metrics with bench_print(), after
+	 * the harness has filled in b->result.
+	 */
+	void (*report)(struct bench *b);
+	/*
+	 * Optional, for benchmarks with several variants: selects the next
+	 * one and sets variant, or returns false when there are no more.
+	 */
+	bool (*next)(struct bench *b);
+	const char *variant;
+	unsigned int flags;
+	/* Upper bound for the batch size, or 0 */
+	u64 max_iterations;
+	struct bench_result result;
+};
+
+#define BENCH(_name, _exec, ...) \
+	{ .name = _name, .exec = _exec, __VA_ARGS__ }
+
+/*
+ * Run the benchmarks whose name matches the command line arguments, or
+ * all of them if there are none.  Arguments are globs, as understood by
+ * simple_glob(); those that start with '-' exclude benchmarks.
+ */
+extern void bench_run_all(struct bench *benches, int nr, int argc,
+			  char **argv);
+extern bool bench_run(struct bench *b);
+extern void bench_print(const char *name, struct bench_result *res);
+
+/*
+ * For benchmarks that collect a distribution of samples: sort the n
+ * samples in place and print their min, p50, p90, p99 and max, in the
+ * columns of bench_print_percentiles_header(), after the caller's label.
+ */
+extern void bench_sort(u64 *v, int n);
+extern void bench_print_percentiles(u64 *v, int n);
+extern void bench_print_percentiles_header(void);
+
+/*
+ * For benchmarks whose variants are a count, e.g. of running counters:
+ * a .next helper that advances *nr from -1 through 0 ... max and names
+ * the variant after it, then resets *nr to -1 and returns false.
+ */
+extern bool bench_next_count(struct bench *b, int *nr, int max);
+
+/*
+ * A .report helper for benchmarks with a baseline variant: records the
+ * cost of one iteration in *baseline if is_baseline, otherwise prints
+ * how much slower than the baseline, described by what, b is.
+ */
+extern void bench_report_baseline(struct bench *b, u64 *baseline,
+				  bool is_baseline, const char *what);
+
+/*
+ * SMP hooks used for BENCH_PARALLEL.  The defaults only run on the
+ * current CPU; architectures with on_cpus() override them.
+ */
+extern int bench_nr_cpus(void);
+extern void bench_on_cpus(void (*func)(void *data), void *data);
+
+#endif /* _BENCH_H_ */
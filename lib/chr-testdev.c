@@ -29,10 +29,11 @@ static void __testdev_send(char *buf, unsigned int len)
 		;
 }
 
-void chr_testdev_exit(int code)
+bool chr_testdev_exit(int code)
 {
 	unsigned int len;
 	static char buf[8];
+	bool ret = false;
 
 	spin_lock(&lock);
 	if (!vcon)
@@ -42,9 +43,11 @@ void chr_testdev_exit(int code)
 	len = strlen(buf);
 
 	__testdev_send(buf, len);
+	ret = true;
 
 out:
 	spin_unlock(&lock);
+	return ret;
 }
 
 void chr_testdev_init(void)
@@ -10,5 +10,6 @@
  * This work is licensed under the terms of the GNU LGPL, version 2.
  */
 extern void chr_testdev_init(void);
-extern void chr_testdev_exit(int code);
+/* Returns false if there is no chr-testdev to send the exit code to */
+extern bool chr_testdev_exit(int code);
 #endif
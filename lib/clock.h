@@ -0,0 +1,22 @@
+#ifndef _CLOCK_H_
+#define _CLOCK_H_
+/*
+ * Architecture-independent helpers around the clock provided by
+ * asm/time.h (get_clock_ticks() and get_clock_hz()).
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include <libcflat.h>
+#include <asm/time.h>
+
+#define NSEC_PER_SEC	1000000000ULL
+
+static inline u64 clock_ticks_to_ns(u64 ticks)
+{
+	u64 hz = get_clock_hz();
+
+	/* split the computation to avoid overflowing 64 bits */
+	return ticks / hz * NSEC_PER_SEC + ticks % hz * NSEC_PER_SEC / hz;
+}
+
+#endif /* _CLOCK_H_ */
@@ -0,0 +1,23 @@
+/*
+ * Migration requests to the test runner
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include <libcflat.h>
+#include <migrate.h>
+
+/*
+ * The runner migrates when it sees this line, then presses a key on the
+ * destination's console; without the runner, a human can do the same.
+ */
+void migrate_quiet(void)
+{
+	puts("Now migrate the VM, then press a key to continue...\n");
+	(void)getchar();
+}
+
+void migrate(void)
+{
+	migrate_quiet();
+	report_info("Migration complete");
+}
@@ -0,0 +1,20 @@
+#ifndef _MIGRATE_H_
+#define _MIGRATE_H_
+/*
+ * Migration requests to the test runner
+ *
+ * Tests in the "migration" group are run by run_migration in
+ * scripts/arch-run.bash, which migrates the VM to a new QEMU every time
+ * the test calls migrate().  The call returns on the destination, so a
+ * test can migrate as many times as it likes.
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+
+/* Ask for a migration and wait until it has completed */
+extern void migrate(void);
+
+/* Like migrate(), without printing anything after the migration */
+extern void migrate_quiet(void);
+
+#endif
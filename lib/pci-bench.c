@@ -0,0 +1,218 @@
+/*
+ * pci-testdev MMIO and PIO exit benchmarks
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include "pci-bench.h"
+#include "asm/page.h"
+
+static struct {
+	void __iomem *mem;
+	unsigned long io;
+	int test_idx;
+	u32 data;
+	unsigned long addr;
+} pci_test = {
+	.test_idx = -1,
+};
+
+bool pci_bench_init(void)
+{
+	struct pci_dev pci_dev;
+	pcidevaddr_t dev;
+	phys_addr_t mem;
+
+	dev = pci_find_dev(PCI_VENDOR_ID_REDHAT, PCI_DEVICE_ID_REDHAT_TEST);
+	if (dev == PCIDEVADDR_INVALID)
+		return false;
+
+	pci_dev_init(&pci_dev, dev);
+	if (!pci_bar_is_valid(&pci_dev, PCI_TESTDEV_BAR_MEM) ||
+	    !pci_bar_is_valid(&pci_dev, PCI_TESTDEV_BAR_IO))
+		return false;
+	assert(pci_bar_is_memory(&pci_dev, PCI_TESTDEV_BAR_MEM));
+	assert(!pci_bar_is_memory(&pci_dev, PCI_TESTDEV_BAR_IO));
+
+	mem = pci_bar_get_addr(&pci_dev, PCI_TESTDEV_BAR_MEM);
+	pci_test.mem = ioremap(mem, PAGE_SIZE);
+	pci_test.io = pci_bar_get_addr(&pci_dev, PCI_TESTDEV_BAR_IO);
+	printf("pci-testdev at %#x membar %" PRIx64 " iobar %lx\n",
+	       pci_dev.bdf, (u64)mem, pci_test.io);
+	return true;
+}
+
+bool pci_bench_prep(void)
+{
+	return pci_test.mem;
+}
+
+void __iomem *pci_bench_mem(void)
+{
+	return pci_test.mem;
+}
+
+static void pci_mem_writeb(void)
+{
+	writeb(pci_test.data, (void __iomem *)pci_test.addr);
+}
+
+static void pci_mem_writew(void)
+{
+	writew(pci_test.data, (void __iomem *)pci_test.addr);
+}
+
+static void pci_mem_writel(void)
+{
+	writel(pci_test.data, (void __iomem *)pci_test.addr);
+}
+
+static void pci_io_writeb(void)
+{
+	outb(pci_test.data, pci_test.addr);
+}
+
+static void pci_io_writew(void)
+{
+	outw(pci_test.data, pci_test.addr);
+}
+
+static void pci_io_writel(void)
+{
+	outl(pci_test.data, pci_test.addr);
+}
+
+static void pci_mem_readb(void)
+{
+	readb(pci_test.mem);
+}
+
+static void pci_mem_readw(void)
+{
+	readw(pci_test.mem);
+}
+
+static void pci_mem_readl(void)
+{
+	readl(pci_test.mem);
+}
+
+static void pci_io_readb(void)
+{
+	inb(pci_test.io);
+}
+
+static void pci_io_readw(void)
+{
+	inw(pci_test.io);
+}
+
+static void pci_io_readl(void)
+{
+	inl(pci_test.io);
+}
+
+static u8 ioreadb(unsigned long addr, bool io)
+{
+	return io ? inb(addr) : readb((void __iomem *)addr);
+}
+
+static u32 ioreadl(unsigned long addr, bool io)
+{
+	return io ? inl(addr) : readl((void __iomem *)addr);
+}
+
+static void iowriteb(unsigned long addr, u8 data, bool io)
+{
+	if (io)
+		outb(data, addr);
+	else
+		writeb(data, (void __iomem *)addr);
+}
+
+/* Select the next test of the device */
+static bool pci_write_next(struct bench *b, bool io)
+{
+	unsigned long base = io ? pci_test.io : (unsigned long)pci_test.mem;
+	static char name[32];
+	u32 offset;
+	u8 width;
+	int i;
+
+	pci_test.test_idx++;
+	iowriteb(base + offsetof(struct pci_test_dev_hdr, test),
+		 pci_test.test_idx, io);
+	width = ioreadb(base + offsetof(struct pci_test_dev_hdr, width), io);
+
+	switch (width) {
+	case 1:
+		b->exec = io ? pci_io_writeb : pci_mem_writeb;
+		break;
+	case 2:
+		b->exec = io ? pci_io_writew : pci_mem_writew;
+		break;
+	case 4:
+		b->exec = io ? pci_io_writel : pci_mem_writel;
+		break;
+	default:
+		/* Reset index for purposes of the next test */
+		pci_test.test_idx = -1;
+		return false;
+	}
+
+	pci_test.data = ioreadl(base + offsetof(struct pci_test_dev_hdr, data),
+				io);
+	offset = ioreadl(base + offsetof(struct pci_test_dev_hdr, offset), io);
+	pci_test.addr = base + offset;
+
+	for (i = 0; i < offset && i < sizeof(name) - 1; ++i) {
+		char c = ioreadb(base + offsetof(struct pci_test_dev_hdr,
+						 name) + i, io);
+		if (!c)
+			break;
+		name[i] = c;
+	}
+	name[i] = 0;
+	b->variant = name;
+	return true;
+}
+
+bool pci_bench_mem_write_next(struct bench *b)
+{
+	return pci_write_next(b, false);
+}
+
+bool pci_bench_io_write_next(struct bench *b)
+{
+	return pci_write_next(b, true);
+}
+
+/* Cycle through the access widths of the reads */
+static bool pci_read_next(struct bench *b, bool io)
+{
+	static void (* const mem_read[])(void) = {
+		pci_mem_readb, pci_mem_readw, pci_mem_readl,
+	};
+	static void (* const io_read[])(void) = {
+		pci_io_readb, pci_io_readw, pci_io_readl,
+	};
+	static const char *widths[] = { "b", "w", "l" };
+	static int i;
+
+	if (i == ARRAY_SIZE(widths)) {
+		i = 0;
+		return false;
+	}
+	b->exec = io ? io_read[i] : mem_read[i];
+	b->variant = widths[i++];
+	return true;
+}
+
+bool pci_bench_mem_read_next(struct bench *b)
+{
+	return pci_read_next(b, false);
+}
+
+bool pci_bench_io_read_next(struct bench *b)
+{
+	return pci_read_next(b, true);
+}
@@ -0,0 +1,35 @@
+#ifndef _PCI_BENCH_H_
+#define _PCI_BENCH_H_
+/*
+ * pci-testdev MMIO and PIO exit benchmarks, shared by x86/vmexit.c
+ * and arm/micro-bench.c
+ *
+ * Writes of the registered width to the test offset of each test are
+ * handled by ioeventfds in KVM, except for the "no-eventfd" test; reads
+ * of the BARs always exit to userspace.
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include <libcflat.h>
+#include <bench.h>
+#include <pci.h>
+#include <asm/io.h>
+
+/*
+ * Find pci-testdev and map its BARs; on architectures that need it,
+ * the caller must have done pci_probe() first.  Returns false if there
+ * is no usable device.
+ */
+extern bool pci_bench_init(void);
+/* The .prep hook of the benchmarks below */
+extern bool pci_bench_prep(void);
+/* The memory BAR, or NULL without pci-testdev */
+extern void __iomem *pci_bench_mem(void);
+
+/* .next hooks: the device's tests for writes, the access widths for reads */
+extern bool pci_bench_mem_write_next(struct bench *b);
+extern bool pci_bench_io_write_next(struct bench *b);
+extern bool pci_bench_mem_read_next(struct bench *b);
+extern bool pci_bench_io_read_next(struct bench *b);
+
+#endif /* _PCI_BENCH_H_ */
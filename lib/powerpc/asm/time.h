@@ -0,0 +1,23 @@
+#ifndef _ASMPOWERPC_TIME_H_
+#define _ASMPOWERPC_TIME_H_
+/*
+ * Clock used for timing measurements: the timebase
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include <libcflat.h>
+#include <asm/processor.h>
+#include <asm/setup.h>
+
+static inline u64 get_clock_ticks(void)
+{
+	return get_tb();
+}
+
+/* Frequency of get_clock_ticks() in Hz, from the device tree */
+static inline u64 get_clock_hz(void)
+{
+	return tb_hz;
+}
+
+#endif /* _ASMPOWERPC_TIME_H_ */
@@ -0,0 +1 @@
+#include "../../powerpc/asm/time.h"
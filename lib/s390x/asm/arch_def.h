@@ -25,6 +25,7 @@ struct psw {
 #define CR0_EXTM_EXTC			0x0000000000002000UL
 #define CR0_EXTM_EMGC			0x0000000000004000UL
 #define CR0_EXTM_MASK			0x0000000000006200UL
+#define CR0_EDAT1			0x0000000000800000UL
 
 struct lowcore {
 	uint8_t		pad_0x0000[0x0080 - 0x0000];	/* 0x0000 */
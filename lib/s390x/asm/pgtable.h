@@ -60,6 +60,7 @@
 #define SEGMENT_TABLE_ENTRIES		2048
 #define SEGMENT_TABLE_LENGTH		3
 #define SEGMENT_SHIFT			20
+#define SEGMENT_SIZE			(1UL << SEGMENT_SHIFT)
 
 #define SEGMENT_ENTRY_ORIGIN		0xfffffffffffff800UL
 #define SEGMENT_ENTRY_SFAA		0xfffffffffff80000UL
@@ -15,6 +15,23 @@
 
 #define STCK_SHIFT_US	(63 - 51)
 #define STCK_MAX	((1UL << 52) - 1)
+/* bit 51 of the TOD clock is incremented every microsecond */
+#define STCK_HZ		(1000000UL << STCK_SHIFT_US)
+
+static inline uint64_t get_clock_ticks(void)
+{
+	uint64_t clk;
+
+	asm volatile(" stck %0 " : : "Q"(clk) : "memory");
+
+	return clk;
+}
+
+/* Frequency of get_clock_ticks() in Hz */
+static inline uint64_t get_clock_hz(void)
+{
+	return STCK_HZ;
+}
 
 static inline uint64_t get_clock_us(void)
 {
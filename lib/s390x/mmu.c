@@ -14,6 +14,7 @@
 #include <asm/pgtable.h>
 #include <asm/arch_def.h>
 #include <asm/barrier.h>
+#include <asm/facility.h>
 #include <vmalloc.h>
 #include "mmu.h"
 
@@ -48,12 +49,18 @@ static void mmu_enable(pgd_t *pgtable)
 	lc->pgm_new_psw.mask |= PSW_MASK_DAT;
 }
 
-static pteval_t *get_pte(pgd_t *pgtable, uintptr_t vaddr)
+static pmd_t *get_pmd(pgd_t *pgtable, uintptr_t vaddr)
 {
 	pgd_t *pgd = pgd_offset(pgtable, vaddr);
 	p4d_t *p4d = p4d_alloc(pgd, vaddr);
 	pud_t *pud = pud_alloc(p4d, vaddr);
-	pmd_t *pmd = pmd_alloc(pud, vaddr);
+
+	return pmd_alloc(pud, vaddr);
+}
+
+static pteval_t *get_pte(pgd_t *pgtable, uintptr_t vaddr)
+{
+	pmd_t *pmd = get_pmd(pgtable, vaddr);
 	pte_t *pte = pte_alloc(pmd, vaddr);
 
 	return &pte_val(*pte);
@@ -61,6 +68,13 @@ static pteval_t *get_pte(pgd_t *pgtable, uintptr_t vaddr)
 
 phys_addr_t virt_to_pte_phys(pgd_t *pgtable, void *vaddr)
 {
+	pmd_t *pmd = get_pmd(pgtable, (uintptr_t)vaddr);
+
+	/* large (EDAT-1) segment */
+	if (!pmd_none(*pmd) && (pmd_val(*pmd) & SEGMENT_ENTRY_FC))
+		return (pmd_val(*pmd) & ~(SEGMENT_SIZE - 1)) +
+		       ((unsigned long)vaddr & (SEGMENT_SIZE - 1));
+
 	return (*get_pte(pgtable, (uintptr_t)vaddr) & PAGE_MASK) +
 	       ((unsigned long)vaddr & ~PAGE_MASK);
 }
@@ -82,6 +96,52 @@ pteval_t *install_page(pgd_t *pgtable, phys_addr_t phys, void *vaddr)
 	return set_pte(pgtable, __pa(phys), vaddr);
 }
 
+/*
+ * Map [phys, phys + len) at vaddr, filling each page table in one pass.
+ * Large segment entries are only used if the caller has enabled EDAT-1 in
+ * CR0.  smp_cpu_setup() loads secondary CPUs with a fixed CR0 that does
+ * not have it, so such mappings must not be used on secondary CPUs.
+ */
+void install_range(pgd_t *pgtable, phys_addr_t phys, void *vaddr, size_t len,
+		   bool large)
+{
+	uintptr_t addr = (uintptr_t)vaddr;
+	pmd_t *pmd;
+	pte_t *pte;
+
+	assert(!((phys | addr | len) & ~PAGE_MASK));
+	large = large && test_facility(8) && (stctg(0) & CR0_EDAT1);
+
+	while (len) {
+		pmd = get_pmd(pgtable, addr);
+
+		if (large && len >= SEGMENT_SIZE &&
+		    !((phys | addr) & (SEGMENT_SIZE - 1))) {
+			do {
+				pmd_val(*pmd) = phys | SEGMENT_ENTRY_FC |
+						SEGMENT_ENTRY_TT_SEGMENT;
+				pmd++;
+				phys += SEGMENT_SIZE;
+				addr += SEGMENT_SIZE;
+				len -= SEGMENT_SIZE;
+			} while (len >= SEGMENT_SIZE && pmd_index(addr));
+			continue;
+		}
+
+		pte = pte_alloc(pmd, addr);
+		do {
+			/* flush the old entry (if we're replacing anything) */
+			if (!(pte_val(*pte) & PAGE_ENTRY_I))
+				ipte(addr, &pte_val(*pte));
+			pte_val(*pte) = __pa(phys);
+			pte++;
+			phys += PAGE_SIZE;
+			addr += PAGE_SIZE;
+			len -= PAGE_SIZE;
+		} while (len && pte_index(addr));
+	}
+}
+
 void protect_page(void *vaddr, unsigned long prot)
 {
 	pteval_t *p_pte = get_pte(table_root, (uintptr_t)vaddr);
@@ -17,6 +17,9 @@
 
 #define VM_MAGIC 0x7E57C0DE
 
+/* Largest physical block used to back an allocation (1G with 4K pages) */
+#define VM_MAX_BLOCK_ORDER (30 - PAGE_SHIFT)
+
 #define GET_METADATA(x) (((struct metadata *)(x)) - 1)
 #define GET_MAGIC(x) (*((unsigned long *)(x) - 1))
 
@@ -84,11 +87,7 @@ void *vmap(phys_addr_t phys, size_t size)
 	mem = p = alloc_vpages(pages);
 
 	phys &= ~(unsigned long long)(PAGE_SIZE - 1);
-	while (pages--) {
-		install_page(page_root, phys, p);
-		phys += PAGE_SIZE;
-		p += PAGE_SIZE;
-	}
+	install_range(page_root, phys, p, pages * PAGE_SIZE, false);
 	return mem;
 }
 
@@ -114,19 +113,49 @@ static void *vm_alloc_one_page(size_t alignment)
 	return p;
 }
 
+/*
+ * Back npages of virtual memory starting at virt with physically contiguous
+ * blocks, each as large as the alignment of virt and the remaining size
+ * allow (but at most VM_MAX_BLOCK_ORDER), falling back to smaller blocks
+ * when the page allocator cannot satisfy the request. Each block is mapped
+ * with a single install_range() call.
+ */
+static void vm_back_pages(void *virt, size_t npages, bool large)
+{
+	uintptr_t p = (uintptr_t)virt;
+	unsigned int order;
+	void *block;
+
+	while (npages) {
+		order = MIN(fls(npages), VM_MAX_BLOCK_ORDER);
+		while (!IS_ALIGNED(p, PAGE_SIZE << order))
+			order--;
+		while (!(block = alloc_pages(order))) {
+			/* out of memory */
+			assert(order);
+			order--;
+		}
+		install_range(page_root, virt_to_phys(block), (void *)p,
+			      PAGE_SIZE << order, large);
+		p += PAGE_SIZE << order;
+		npages -= BIT(order);
+	}
+}
+
 /*
  * Allocate virtual memory, with the specified minimum alignment.
  * If the allocation fits in one page, only one page is allocated. Otherwise
  * enough pages are allocated for the object, plus one to keep metadata
  * information about the allocation.
+ * Multi-page allocations are aligned to their size (up to the largest block
+ * order), so that they can be backed with large physical blocks and mapped
+ * with large pages unless VM_ALLOC_NOHUGE is specified.
  */
-static void *vm_memalign(size_t alignment, size_t size)
+static void *__vm_memalign(size_t alignment, size_t size, unsigned int flags)
 {
 	struct metadata *m;
 	phys_addr_t pa;
-	uintptr_t p;
 	void *mem;
-	size_t i;
 
 	if (!size)
 		return NULL;
@@ -139,30 +168,34 @@ static void *vm_memalign(size_t alignment, size_t size)
 		return vm_alloc_one_page(alignment);
 	size = PAGE_ALIGN(size) / PAGE_SIZE;
 	alignment = get_order(PAGE_ALIGN(alignment) / PAGE_SIZE);
+	alignment = MAX(alignment, MIN(fls(size), VM_MAX_BLOCK_ORDER));
 	mem = do_alloc_vpages(size, alignment, true);
-	p = (uintptr_t)mem;
+	/* the metadata page is allocated and mapped separately */
+	pa = virt_to_phys(alloc_page());
+	assert(pa);
+	install_page(page_root, pa, mem);
 	/* skip the metadata page */
-	mem = (void *)(p + PAGE_SIZE);
-	/*
-	 * time to actually allocate the physical pages to back our virtual
-	 * allocation; note that we need to allocate one extra page (for the
-	 * metadata), hence the <=
-	 */
-	for (i = 0; i <= size; i++, p += PAGE_SIZE) {
-		pa = virt_to_phys(alloc_page());
-		assert(pa);
-		install_page(page_root, pa, (void *)p);
-	}
+	mem = (void *)((uintptr_t)mem + PAGE_SIZE);
+	/* time to actually allocate the physical pages to back our allocation */
+	vm_back_pages(mem, size, !(flags & VM_ALLOC_NOHUGE));
 	m = GET_METADATA(mem);
 	m->npages = size;
 	m->magic = VM_MAGIC;
 	return mem;
 }
 
+static void *vm_memalign(size_t alignment, size_t size)
+{
+	return __vm_memalign(alignment, size, 0);
+}
+
 static void vm_free(void *mem)
 {
 	struct metadata *m;
-	uintptr_t ptr, end;
+	unsigned int order;
+	uintptr_t ptr;
+	void *block;
+	size_t i;
 
 	/* the pointer is not page-aligned, it was a single-page allocation */
 	if (!IS_ALIGNED((uintptr_t)mem, PAGE_SIZE)) {
@@ -176,12 +209,15 @@ static void vm_free(void *mem)
 	m = GET_METADATA(mem);
 	assert(m->magic == VM_MAGIC);
 	assert(m->npages > 0);
-	/* free all the pages including the metadata page */
+	/* free all the physical blocks, they might be of different sizes */
+	for (i = 0; i < m->npages; i += BIT(order)) {
+		ptr = (uintptr_t)mem + i * PAGE_SIZE;
+		block = phys_to_virt(virt_to_pte_phys(page_root, (void *)ptr));
+		order = get_block_order(block);
+		free_pages(block);
+	}
+	/* free the metadata page last, since we were still using it */
 	ptr = (uintptr_t)mem - PAGE_SIZE;
-	end = ptr + m->npages * PAGE_SIZE;
-	for ( ; ptr < end; ptr += PAGE_SIZE)
-		free_page(phys_to_virt(virt_to_pte_phys(page_root, (void *)ptr)));
-	/* free the last one separately to avoid overflow issues */
 	free_page(phys_to_virt(virt_to_pte_phys(page_root, (void *)ptr)));
 }
 
@@ -191,6 +227,12 @@ static struct alloc_ops vmalloc_ops = {
 	.align_min = PAGE_SIZE,
 };
 
+void *vm_memalign_flags(size_t alignment, size_t size, unsigned int flags)
+{
+	assert(alloc_ops == &vmalloc_ops);
+	return __vm_memalign(alignment, size, flags);
+}
+
 void __attribute__((__weak__)) find_highmem(void)
 {
 }
@@ -22,7 +22,23 @@ extern phys_addr_t virt_to_pte_phys(pgd_t *pgtable, void *virt);
 /* Map the virtual address to the physical address for the given page tables */
 extern pteval_t *install_page(pgd_t *pgtable, phys_addr_t phys, void *virt);
 
+/*
+ * Map a physically contiguous range, walking the page tables once per table
+ * rather than once per page; if large is true, the largest mappings allowed
+ * by the alignment of phys and virt are used (x86 2M/1G, arm sections,
+ * s390x segments with EDAT-1).
+ */
+extern void install_range(pgd_t *pgtable, phys_addr_t phys, void *virt,
+			  size_t len, bool large);
+
 /* Map consecutive physical pages */
 void *vmap(phys_addr_t phys, size_t size);
 
+/* Only map the allocation with base pages (e.g. to change single PTEs) */
+#define VM_ALLOC_NOHUGE		(1U << 0)
+
+/* Like memalign(), with VM_ALLOC_* flags; the result is freed with free() */
+extern void *vm_memalign_flags(size_t alignment, size_t size,
+			       unsigned int flags);
+
 #endif
@@ -10,6 +10,11 @@
 #define RSDT_SIGNATURE ACPI_SIGNATURE('R','S','D','T')
 #define FACP_SIGNATURE ACPI_SIGNATURE('F','A','C','P')
 #define FACS_SIGNATURE ACPI_SIGNATURE('F','A','C','S')
+#define MCFG_SIGNATURE ACPI_SIGNATURE('M','C','F','G')
+
+/* The PM timer at pm_tmr_blk, a 24-bit counter */
+#define PM_TIMER_HZ		3579545
+#define PM_TIMER_MASK		0xffffff
 
 struct rsdp_descriptor {        /* Root System Descriptor Pointer */
     u64 signature;              /* ACPI signature, contains "RSD PTR " */
@@ -99,6 +104,20 @@ struct facs_descriptor_rev1
     u8  reserved3 [40];         /* Reserved - must be zero */
 };
 
+struct mcfg_allocation {
+    u64 base_address;           /* Base address of the ECAM area */
+    u16 pci_segment;            /* PCI segment group number */
+    u8  start_bus;              /* First bus decoded by this area */
+    u8  end_bus;                /* Last bus decoded by this area */
+    u32 reserved;
+} __attribute__((packed));
+
+struct mcfg_descriptor {
+    ACPI_TABLE_HEADER_DEF
+    u8  reserved[8];
+    struct mcfg_allocation allocation[0];
+} __attribute__((packed));
+
 void* find_acpi_table_addr(u32 sig);
 
 #endif
@@ -11,44 +11,28 @@
 
 #define PCI_CONF1_ADDRESS(dev, reg)	((0x1 << 31) | (dev << 8) | reg)
 
-static inline uint8_t pci_config_readb(pcidevaddr_t dev, uint8_t reg)
-{
-    outl(PCI_CONF1_ADDRESS(dev, reg), 0xCF8);
-    return inb(0xCFC);
-}
-
-static inline uint16_t pci_config_readw(pcidevaddr_t dev, uint8_t reg)
-{
-    outl(PCI_CONF1_ADDRESS(dev, reg), 0xCF8);
-    return inw(0xCFC);
-}
-
-static inline uint32_t pci_config_readl(pcidevaddr_t dev, uint8_t reg)
-{
-    outl(PCI_CONF1_ADDRESS(dev, reg), 0xCF8);
-    return inl(0xCFC);
-}
-
-static inline void pci_config_writeb(pcidevaddr_t dev, uint8_t reg,
-                                     uint8_t val)
-{
-    outl(PCI_CONF1_ADDRESS(dev, reg), 0xCF8);
-    outb(val, 0xCFC);
-}
-
-static inline void pci_config_writew(pcidevaddr_t dev, uint8_t reg,
-                                     uint16_t val)
-{
-    outl(PCI_CONF1_ADDRESS(dev, reg), 0xCF8);
-    outw(val, 0xCFC);
-}
-
-static inline void pci_config_writel(pcidevaddr_t dev, uint8_t reg,
-                                     uint32_t val)
-{
-    outl(PCI_CONF1_ADDRESS(dev, reg), 0xCF8);
-    outl(val, 0xCFC);
-}
+/*
+ * Config space is accessed through MMCONFIG (ECAM) if the firmware
+ * describes it in the ACPI MCFG table, as on q35, and otherwise through
+ * the 0xCF8/0xCFC port pair.  Only MMCONFIG reaches the extended config
+ * space above offset 0xff; with the port pair, reads of it return all
+ * ones and writes are dropped.
+ */
+enum pci_config_access {
+    PCI_CONFIG_CONF1,
+    PCI_CONFIG_MMCFG,
+};
+
+/* Returns false, and leaves the mechanism alone, if it is not available */
+extern bool pci_set_config_access(enum pci_config_access access);
+extern enum pci_config_access pci_get_config_access(void);
+
+extern uint8_t pci_config_readb(pcidevaddr_t dev, uint16_t reg);
+extern uint16_t pci_config_readw(pcidevaddr_t dev, uint16_t reg);
+extern uint32_t pci_config_readl(pcidevaddr_t dev, uint16_t reg);
+extern void pci_config_writeb(pcidevaddr_t dev, uint16_t reg, uint8_t val);
+extern void pci_config_writew(pcidevaddr_t dev, uint16_t reg, uint16_t val);
+extern void pci_config_writel(pcidevaddr_t dev, uint16_t reg, uint32_t val);
 
 static inline
 phys_addr_t pci_translate_addr(pcidevaddr_t dev __unused, uint64_t addr)
@@ -0,0 +1,19 @@
+#ifndef _ASM_X86_TIME_H_
+#define _ASM_X86_TIME_H_
+/*
+ * Clock used for timing measurements: the TSC
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include "libcflat.h"
+#include "x86/processor.h"
+
+static inline u64 get_clock_ticks(void)
+{
+	return rdtsc();
+}
+
+/* Frequency of get_clock_ticks() in Hz */
+extern u64 get_clock_hz(void);
+
+#endif /* _ASM_X86_TIME_H_ */
@@ -0,0 +1,86 @@
+/*
+ * KVM async page fault support
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include "libcflat.h"
+#include "processor.h"
+#include "apic-defs.h"
+#include "apic.h"
+#include "desc.h"
+#include "isr.h"
+#include "smp.h"
+#include "asyncpf.h"
+#include "asm/io.h"
+
+static volatile struct kvm_vcpu_pv_apf_data apf_data[MAX_TEST_CPUS];
+static apf_callback_t apf_not_present, apf_ready;
+
+bool apf_int_supported(void)
+{
+	return kvm_has_feature(KVM_FEATURE_ASYNC_PF_INT);
+}
+
+static void apf_pf_handler(struct ex_regs *regs)
+{
+	volatile struct kvm_vcpu_pv_apf_data *apf = &apf_data[smp_id()];
+	u32 reason = apf->flags;
+
+	apf->flags = 0;
+	switch (reason) {
+	case KVM_PV_REASON_PAGE_NOT_PRESENT:
+		apf_not_present(read_cr2());
+		break;
+	case KVM_PV_REASON_PAGE_READY:
+		apf_ready(read_cr2());
+		break;
+	default:
+		report_abort("unexpected #PF at %#lx", read_cr2());
+	}
+}
+
+static void apf_int_handler(isr_regs_t *regs)
+{
+	volatile struct kvm_vcpu_pv_apf_data *apf = &apf_data[smp_id()];
+
+	eoi();
+	apf_ready(apf->token);
+	apf->token = 0;
+	/* Let KVM deliver the next "page ready" notification */
+	wrmsr(MSR_KVM_ASYNC_PF_ACK, 1);
+}
+
+bool apf_enable(unsigned int flags, apf_callback_t not_present,
+		apf_callback_t ready)
+{
+	volatile struct kvm_vcpu_pv_apf_data *apf = &apf_data[smp_id()];
+	u64 val;
+
+	if (!kvm_has_feature(KVM_FEATURE_ASYNC_PF))
+		return false;
+	if ((flags & APF_INT) && !apf_int_supported())
+		return false;
+
+	apf_not_present = not_present;
+	apf_ready = ready;
+	apf->flags = 0;
+	apf->token = 0;
+	handle_exception(PF_VECTOR, apf_pf_handler);
+
+	val = virt_to_phys((void *)apf) |
+	      KVM_ASYNC_PF_ENABLED | KVM_ASYNC_PF_SEND_ALWAYS;
+	if (flags & APF_INT) {
+		/* The vector must be set before enabling async PF */
+		handle_irq(APF_VECTOR, apf_int_handler);
+		wrmsr(MSR_KVM_ASYNC_PF_INT, APF_VECTOR);
+		val |= KVM_ASYNC_PF_DELIVERY_AS_INT;
+	}
+	wrmsr(MSR_KVM_ASYNC_PF_EN, val);
+	return true;
+}
+
+void apf_disable(void)
+{
+	wrmsr(MSR_KVM_ASYNC_PF_EN, 0);
+	handle_exception(PF_VECTOR, NULL);
+}
@@ -0,0 +1,55 @@
+#ifndef __X86_ASYNCPF__
+#define __X86_ASYNCPF__
+
+#include "libcflat.h"
+#include "kvm_para.h"
+
+#define KVM_FEATURE_ASYNC_PF		4
+#define KVM_FEATURE_ASYNC_PF_INT	14
+
+#define MSR_KVM_ASYNC_PF_EN		0x4b564d02
+#define MSR_KVM_ASYNC_PF_INT		0x4b564d06
+#define MSR_KVM_ASYNC_PF_ACK		0x4b564d07
+
+#define KVM_ASYNC_PF_ENABLED			(1 << 0)
+#define KVM_ASYNC_PF_SEND_ALWAYS		(1 << 1)
+#define KVM_ASYNC_PF_DELIVERY_AS_PF_VMEXIT	(1 << 2)
+#define KVM_ASYNC_PF_DELIVERY_AS_INT		(1 << 3)
+
+#define KVM_PV_REASON_PAGE_NOT_PRESENT	1
+#define KVM_PV_REASON_PAGE_READY	2
+
+/* Vector used for "page ready" notifications with APF_INT */
+#define APF_VECTOR			0xec
+
+struct kvm_vcpu_pv_apf_data {
+	/* "page not present" events, delivered as #PF with the token in CR2 */
+	u32 flags;
+	/* "page ready" events, delivered through APF_VECTOR */
+	u32 token;
+	u8 pad[56];
+	u32 enabled;
+} __attribute__((aligned(64)));
+
+/* Use the interrupt-based "page ready" notification */
+#define APF_INT		(1 << 0)
+
+typedef void (*apf_callback_t)(u32 token);
+
+/*
+ * Enable async page faults on the current CPU.
+ *
+ * not_present is called from the #PF handler, with interrupts disabled,
+ * when the host starts swapping in the page identified by token; the guest
+ * must not touch that page again until ready is called with the same token.
+ * ready is called from the APF_VECTOR interrupt handler with APF_INT, or
+ * from the #PF handler otherwise; a token of ~0 wakes up all waiters.
+ *
+ * Returns false if the host does not support the requested delivery mode.
+ */
+bool apf_enable(unsigned int flags, apf_callback_t not_present,
+		apf_callback_t ready);
+void apf_disable(void);
+bool apf_int_supported(void);
+
+#endif
@@ -83,6 +83,19 @@ void puts(const char *s)
 	spin_unlock(&lock);
 }
 
+int __getchar(void)
+{
+	int c = -1;
+
+	spin_lock(&lock);
+	/* LSR: data ready */
+	if (inb(serial_iobase + 0x05) & 0x01)
+		c = inb(serial_iobase + 0x00);
+	spin_unlock(&lock);
+
+	return c;
+}
+
 void exit(int code)
 {
 #ifdef USE_SERIAL
@@ -0,0 +1,94 @@
+/*
+ * KVM paravirtual interfaces
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include "libcflat.h"
+#include "processor.h"
+#include "msr.h"
+#include "apic-defs.h"
+#include "smp.h"
+#include "kvm_para.h"
+#include "asm/barrier.h"
+#include "asm/io.h"
+
+static volatile struct kvm_steal_time steal_time[MAX_TEST_CPUS];
+
+bool steal_time_enable(void)
+{
+	volatile struct kvm_steal_time *st = &steal_time[smp_id()];
+
+	if (!kvm_has_feature(KVM_FEATURE_STEAL_TIME))
+		return false;
+
+	memset((void *)st, 0, sizeof(*st));
+	wrmsr(MSR_KVM_STEAL_TIME, virt_to_phys((void *)st) | KVM_MSR_ENABLED);
+	return true;
+}
+
+void steal_time_disable(void)
+{
+	wrmsr(MSR_KVM_STEAL_TIME, 0);
+}
+
+u64 steal_time_ns(int cpu)
+{
+	volatile struct kvm_steal_time *st = &steal_time[cpu];
+	u32 version;
+	u64 steal;
+
+	/* KVM makes the version odd while it updates the area */
+	do {
+		version = st->version;
+		smp_rmb();
+		steal = st->steal;
+		smp_rmb();
+	} while ((version & 1) || version != st->version);
+
+	return steal;
+}
+
+bool steal_time_preempted(int cpu)
+{
+	return steal_time[cpu].preempted & KVM_VCPU_PREEMPTED;
+}
+
+bool steal_time_defer_flush(int cpu)
+{
+	volatile u8 *preempted = &steal_time[cpu].preempted;
+	u8 state = *preempted;
+
+	if (!(state & KVM_VCPU_PREEMPTED))
+		return false;
+
+	/* Fails if KVM has cleared the flags because the vCPU runs again */
+	return __sync_bool_compare_and_swap(preempted, state,
+					    state | KVM_VCPU_FLUSH_TLB);
+}
+
+bool steal_time_flush_pending(int cpu)
+{
+	return steal_time[cpu].preempted & KVM_VCPU_FLUSH_TLB;
+}
+
+long kvm_hypercall(unsigned int nr, unsigned long a0, unsigned long a1,
+		   unsigned long a2, unsigned long a3)
+{
+	static int amd = -1;
+	long ret;
+
+	if (amd < 0)
+		amd = is_amd();
+
+	if (amd)
+		asm volatile("vmmcall"
+			     : "=a"(ret)
+			     : "a"(nr), "b"(a0), "c"(a1), "d"(a2), "S"(a3)
+			     : "memory");
+	else
+		asm volatile("vmcall"
+			     : "=a"(ret)
+			     : "a"(nr), "b"(a0), "c"(a1), "d"(a2), "S"(a3)
+			     : "memory");
+	return ret;
+}
@@ -0,0 +1,60 @@
+#ifndef __X86_KVM_PARA__
+#define __X86_KVM_PARA__
+
+#include "libcflat.h"
+#include "processor.h"
+
+#define KVM_CPUID_FEATURES		0x40000001
+#define KVM_FEATURE_CLOCKSOURCE2	3
+#define KVM_FEATURE_STEAL_TIME		5
+#define KVM_FEATURE_PV_TLB_FLUSH	9
+#define KVM_FEATURE_PV_SEND_IPI		11
+
+#define KVM_HC_SEND_IPI			10
+
+#define MSR_KVM_STEAL_TIME		0x4b564d03
+#define MSR_KVM_POLL_CONTROL		0x4b564d05
+
+#define KVM_MSR_ENABLED			1
+#define KVM_VCPU_PREEMPTED		(1 << 0)
+#define KVM_VCPU_FLUSH_TLB		(1 << 1)
+
+struct kvm_steal_time {
+	u64 steal;
+	u32 version;
+	u32 flags;
+	u8 preempted;
+	u8 u8_pad[3];
+	u32 pad[11];
+} __attribute__((aligned(64)));
+
+static inline bool kvm_has_feature(int feature)
+{
+	return this_cpu_has(X86_FEATURE_HYPERVISOR) &&
+	       (cpuid(KVM_CPUID_FEATURES).a & (1 << feature));
+}
+
+/*
+ * Register the steal time area of the current CPU.  KVM then accounts
+ * the time the vCPU was runnable but not running, and sets
+ * KVM_VCPU_PREEMPTED while the vCPU thread is scheduled out.
+ */
+bool steal_time_enable(void);
+void steal_time_disable(void);
+u64 steal_time_ns(int cpu);
+bool steal_time_preempted(int cpu);
+
+/*
+ * With KVM_FEATURE_PV_TLB_FLUSH, a CPU that would send a TLB shootdown
+ * to a preempted vCPU can instead ask KVM to flush its TLB the next time
+ * it runs.  Returns false if the vCPU was not preempted (anymore), in
+ * which case the caller has to send the IPI.
+ */
+bool steal_time_defer_flush(int cpu);
+bool steal_time_flush_pending(int cpu);
+
+/* VMCALL or VMMCALL depending on the vendor, returns the result in RAX */
+long kvm_hypercall(unsigned int nr, unsigned long a0, unsigned long a1,
+		   unsigned long a2, unsigned long a3);
+
+#endif
@@ -0,0 +1,190 @@
+/*
+ * PCI config space access: MMCONFIG or the 0xCF8/0xCFC port pair
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include "libcflat.h"
+#include "acpi.h"
+#include "processor.h"
+#include "vm.h"
+#include "asm/page.h"
+#include "pci.h"
+#include "asm/pci.h"
+
+#define MMCFG_BUS_SIZE		(1ul << 20)
+
+static bool mmcfg_probed;
+static phys_addr_t mmcfg_base;
+static u8 mmcfg_start_bus, mmcfg_end_bus;
+
+/* The mapping of each bus depends on the page tables in use */
+static ulong mmcfg_cr3;
+static void *mmcfg_bus[256];
+
+static int access = -1;
+
+static bool mmcfg_probe(void)
+{
+	struct mcfg_descriptor *mcfg;
+	struct mcfg_allocation *a;
+
+	if (mmcfg_probed)
+		return mmcfg_base;
+	mmcfg_probed = true;
+
+	mcfg = find_acpi_table_addr(MCFG_SIGNATURE);
+	if (!mcfg)
+		return false;
+
+	for (a = mcfg->allocation; (void *)(a + 1) <= (void *)mcfg + mcfg->length; a++) {
+		if (a->pci_segment == 0) {
+			mmcfg_base = a->base_address;
+			mmcfg_start_bus = a->start_bus;
+			mmcfg_end_bus = a->end_bus;
+			break;
+		}
+	}
+	return mmcfg_base;
+}
+
+static bool identity_mapped(phys_addr_t phys)
+{
+	struct pte_search s;
+	u64 mask;
+
+	if (phys != (ulong)phys)
+		return false;
+
+	s = find_pte_level(current_page_table(), (void *)(ulong)phys, 1);
+	if (!found_leaf_pte(s) || !(*s.pte & PT_PRESENT_MASK))
+		return false;
+
+	mask = (1ull << PGDIR_BITS(s.level)) - 1;
+	return (*s.pte & PT_ADDR_MASK & ~mask) == (phys & ~mask);
+}
+
+static void *mmcfg_addr(pcidevaddr_t dev, uint16_t reg)
+{
+	int bus = PCI_BDF_GET_BUS(dev);
+	phys_addr_t phys;
+
+	if (bus < mmcfg_start_bus || bus > mmcfg_end_bus)
+		return NULL;
+
+	if (read_cr3() != mmcfg_cr3) {
+		memset(mmcfg_bus, 0, sizeof(mmcfg_bus));
+		mmcfg_cr3 = read_cr3();
+	}
+
+	if (!mmcfg_bus[bus]) {
+		phys = mmcfg_base + (bus - mmcfg_start_bus) * MMCFG_BUS_SIZE;
+		mmcfg_bus[bus] = identity_mapped(phys) ? phys_to_virt(phys) :
+				 ioremap(phys, MMCFG_BUS_SIZE);
+	}
+
+	return mmcfg_bus[bus] + (PCI_BDF_GET_DEVFN(dev) << 12) + reg;
+}
+
+bool pci_set_config_access(enum pci_config_access mode)
+{
+	if (mode == PCI_CONFIG_MMCFG && !mmcfg_probe())
+		return false;
+
+	access = mode;
+	return true;
+}
+
+enum pci_config_access pci_get_config_access(void)
+{
+	if (access < 0)
+		access = mmcfg_probe() ? PCI_CONFIG_MMCFG : PCI_CONFIG_CONF1;
+
+	return access;
+}
+
+/* Returns NULL if the access has to go through the port pair */
+static void *config_addr(pcidevaddr_t dev, uint16_t reg)
+{
+	if (pci_get_config_access() != PCI_CONFIG_MMCFG)
+		return NULL;
+
+	return mmcfg_addr(dev, reg);
+}
+
+uint8_t pci_config_readb(pcidevaddr_t dev, uint16_t reg)
+{
+	void *addr = config_addr(dev, reg);
+
+	if (addr)
+		return readb(addr);
+	if (reg > 0xff)
+		return 0xff;
+	outl(PCI_CONF1_ADDRESS(dev, reg), 0xCF8);
+	return inb(0xCFC);
+}
+
+uint16_t pci_config_readw(pcidevaddr_t dev, uint16_t reg)
+{
+	void *addr = config_addr(dev, reg);
+
+	if (addr)
+		return readw(addr);
+	if (reg > 0xff)
+		return 0xffff;
+	outl(PCI_CONF1_ADDRESS(dev, reg), 0xCF8);
+	return inw(0xCFC);
+}
+
+uint32_t pci_config_readl(pcidevaddr_t dev, uint16_t reg)
+{
+	void *addr = config_addr(dev, reg);
+
+	if (addr)
+		return readl(addr);
+	if (reg > 0xff)
+		return 0xffffffff;
+	outl(PCI_CONF1_ADDRESS(dev, reg), 0xCF8);
+	return inl(0xCFC);
+}
+
+void pci_config_writeb(pcidevaddr_t dev, uint16_t reg, uint8_t val)
+{
+	void *addr = config_addr(dev, reg);
+
+	if (addr) {
+		writeb(val, addr);
+		return;
+	}
+	if (reg > 0xff)
+		return;
+	outl(PCI_CONF1_ADDRESS(dev, reg), 0xCF8);
+	outb(val, 0xCFC);
+}
+
+void pci_config_writew(pcidevaddr_t dev, uint16_t reg, uint16_t val)
+{
+	void *addr = config_addr(dev, reg);
+
+	if (addr) {
+		writew(val, addr);
+		return;
+	}
+	if (reg > 0xff)
+		return;
+	outl(PCI_CONF1_ADDRESS(dev, reg), 0xCF8);
+	outw(val, 0xCFC);
+}
+
+void pci_config_writel(pcidevaddr_t dev, uint16_t reg, uint32_t val)
+{
+	void *addr = config_addr(dev, reg);
+
+	if (addr) {
+		writel(val, addr);
+		return;
+	}
+	if (reg > 0xff)
+		return;
+	outl(PCI_CONF1_ADDRESS(dev, reg), 0xCF8);
+	outl(val, 0xCFC);
+}
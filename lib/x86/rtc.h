@@ -0,0 +1,32 @@
+#ifndef __X86_RTC__
+#define __X86_RTC__
+
+#include "libcflat.h"
+#include "asm/io.h"
+
+/* MC146818 RTC and CMOS registers, behind index port 0x70 */
+#define RTC_SECONDS_ALARM	1
+#define RTC_MINUTES_ALARM	3
+#define RTC_HOURS_ALARM		5
+#define RTC_ALARM_DONT_CARE	0xC0
+
+#define RTC_REG_A		10
+#define RTC_REG_B		11
+#define RTC_REG_C		12
+
+#define REG_A_UIP		0x80
+#define REG_B_AIE		0x20
+
+static inline int rtc_in(u8 reg)
+{
+	outb(reg, 0x70);
+	return inb(0x71);
+}
+
+static inline void rtc_out(u8 reg, u8 val)
+{
+	outb(reg, 0x70);
+	outb(val, 0x71);
+}
+
+#endif
@@ -4,8 +4,10 @@
 #include "atomic.h"
 #include "smp.h"
 #include "apic.h"
+#include "apic-defs.h"
 #include "fwcfg.h"
 #include "desc.h"
+#include "bench.h"
 
 #define IPI_VECTOR 0x20
 
@@ -19,6 +21,9 @@ static volatile bool ipi_wait;
 static int _cpu_count;
 static atomic_t active_cpus;
 
+u64 boot_tsc_start, boot_tsc_ap_init, boot_tsc_smp_init, boot_tsc_smp_done;
+u64 boot_tsc_online[MAX_TEST_CPUS], boot_tsc_ready[MAX_TEST_CPUS];
+
 static __attribute__((used)) void ipi(void)
 {
     void (*function)(void *data) = ipi_function;
@@ -63,6 +68,7 @@ int smp_id(void)
 static void setup_smp_id(void *data)
 {
     asm ("mov %0, %%gs:0" : : "r"(apic_id()) : "memory");
+    boot_tsc_ready[apic_id()] = rdtsc();
 }
 
 static void __on_cpu(int cpu, void (*function)(void *data), void *data,
@@ -118,6 +124,7 @@ void smp_init(void)
     int i;
     void ipi_entry(void);
 
+    boot_tsc_smp_init = rdtsc();
     _cpu_count = fwcfg_get_nb_cpus();
 
     setup_idt();
@@ -129,6 +136,7 @@ void smp_init(void)
         on_cpu(i, setup_smp_id, 0);
 
     atomic_inc(&active_cpus);
+    boot_tsc_smp_done = rdtsc();
 }
 
 static void do_reset_apic(void *data)
@@ -146,3 +154,14 @@ void smp_reset_apic(void)
 
     atomic_inc(&active_cpus);
 }
+
+/* SMP hooks for the benchmark harness */
+int bench_nr_cpus(void)
+{
+    return cpu_count();
+}
+
+void bench_on_cpus(void (*func)(void *data), void *data)
+{
+    on_cpus(func, data);
+}
@@ -1,5 +1,6 @@
 #ifndef __SMP_H
 #define __SMP_H
+#include <libcflat.h>
 #include <asm/spinlock.h>
 
 void smp_init(void);
@@ -12,4 +13,13 @@ void on_cpu_async(int cpu, void (*function)(void *data), void *data);
 void on_cpus(void (*function)(void *data), void *data);
 void smp_reset_apic(void);
 
+/*
+ * TSC values recorded while bringing up the CPUs: the first instruction
+ * of the BSP, the INIT/SIPI broadcast, start and end of smp_init(), and
+ * for each CPU (indexed by APIC ID) when it came online in ap_init and
+ * when it ran its part of smp_init().
+ */
+extern u64 boot_tsc_start, boot_tsc_ap_init, boot_tsc_smp_init, boot_tsc_smp_done;
+extern u64 boot_tsc_online[], boot_tsc_ready[];
+
 #endif
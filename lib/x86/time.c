@@ -0,0 +1,64 @@
+/*
+ * TSC frequency discovery
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include "libcflat.h"
+#include "processor.h"
+#include "acpi.h"
+#include "asm/io.h"
+#include "asm/time.h"
+
+#define PM_TIMER_CALIBRATE_MS	10
+
+static u64 tsc_hz;
+
+static u64 tsc_hz_from_cpuid(void)
+{
+	struct cpuid c;
+
+	/* Time Stamp Counter and Nominal Core Crystal Clock leaf */
+	if (cpuid(0).a >= 0x15) {
+		c = cpuid(0x15);
+		if (c.a && c.b && c.c)
+			return (u64)c.c * c.b / c.a;
+	}
+
+	/* KVM/VMware timing information leaf (TSC frequency in kHz) */
+	if (this_cpu_has(X86_FEATURE_HYPERVISOR) &&
+	    cpuid(0x40000000).a >= 0x40000010) {
+		c = cpuid(0x40000010);
+		if (c.a)
+			return (u64)c.a * 1000;
+	}
+
+	return 0;
+}
+
+/* Calibrate the TSC against the ACPI PM timer */
+static u64 tsc_hz_from_pm_timer(void)
+{
+	struct fadt_descriptor_rev1 *fadt = find_acpi_table_addr(FACP_SIGNATURE);
+	u32 start, ticks;
+	u64 t1, t2;
+
+	assert_msg(fadt && fadt->pm_tmr_blk, "cannot determine the TSC frequency");
+
+	start = inl(fadt->pm_tmr_blk);
+	t1 = rdtsc();
+	do {
+		ticks = (inl(fadt->pm_tmr_blk) - start) & PM_TIMER_MASK;
+	} while (ticks < PM_TIMER_HZ / 1000 * PM_TIMER_CALIBRATE_MS);
+	t2 = rdtsc();
+
+	return (t2 - t1) * PM_TIMER_HZ / ticks;
+}
+
+u64 get_clock_hz(void)
+{
+	if (!tsc_hz)
+		tsc_hz = tsc_hz_from_cpuid();
+	if (!tsc_hz)
+		tsc_hz = tsc_hz_from_pm_timer();
+	return tsc_hz;
+}
@@ -115,6 +115,54 @@ void install_pages(pgd_t *cr3, phys_addr_t phys, size_t len, void *virt)
 	}
 }
 
+/*
+ * Map the physically contiguous range [phys, phys + len) at virt.  Each page
+ * table is walked to once and then filled sequentially; if large is true,
+ * 2M (4M on i386) and 1G pages are used wherever phys and virt allow it.
+ */
+void install_range(pgd_t *cr3, phys_addr_t phys, void *virt, size_t len,
+		   bool large)
+{
+	pteval_t prot = PT_PRESENT_MASK | PT_WRITABLE_MASK | PT_USER_MASK;
+	uintptr_t va = (uintptr_t)virt;
+	int level, max_level = 1;
+	pteval_t *ptep;
+	size_t size;
+
+	assert(phys % PAGE_SIZE == 0);
+	assert(va % PAGE_SIZE == 0);
+	assert(len % PAGE_SIZE == 0);
+
+	if (large) {
+		max_level = 2;
+#ifdef __x86_64__
+		if (this_cpu_has(X86_FEATURE_GBPAGES))
+			max_level = 3;
+#endif
+	}
+
+	while (len) {
+		for (level = max_level; level > 1; level--) {
+			size = 1ul << PGDIR_BITS(level);
+			if (len >= size && IS_ALIGNED(phys | va, size))
+				break;
+		}
+		size = 1ul << PGDIR_BITS(level);
+		ptep = install_pte(cr3, level, (void *)va,
+				   phys | prot | (level > 1 ? PT_PAGE_SIZE_MASK : 0), 0);
+
+		/* fill the rest of this page table without walking it again */
+		for (;;) {
+			phys += size;
+			va += size;
+			len -= size;
+			if (len < size || !PGDIR_OFFSET(va, level))
+				break;
+			*++ptep = phys | prot | (level > 1 ? PT_PAGE_SIZE_MASK : 0);
+		}
+	}
+}
+
 bool any_present_pages(pgd_t *cr3, void *virt, size_t len)
 {
 	uintptr_t max = (uintptr_t) virt + len;
@@ -189,7 +237,11 @@ void *setup_mmu(phys_addr_t end_of_memory)
 
 phys_addr_t virt_to_pte_phys(pgd_t *cr3, void *mem)
 {
-    return (*get_pte(cr3, mem) & PT_ADDR_MASK) + ((ulong)mem & (PAGE_SIZE - 1));
+    struct pte_search search = find_pte_level(cr3, mem, 1);
+    ulong mask = (1ul << PGDIR_BITS(search.level)) - 1;
+
+    assert(found_leaf_pte(search));
+    return (*search.pte & PT_ADDR_MASK & ~(pteval_t)mask) + ((ulong)mem & mask);
 }
 
 /*
@@ -0,0 +1,54 @@
+/*
+ * Measure the cost of hypercalls
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include <libcflat.h>
+#include <alloc.h>
+#include <bench.h>
+#include <asm/hcall.h>
+#include <asm/page.h>
+
+#define H_ZERO_PAGE	(1UL << (63-48))
+
+#define mfspr(nr) ({ \
+	uint64_t ret; \
+	asm volatile("mfspr %0,%1" : "=r"(ret) : "i"(nr)); \
+	ret; \
+})
+
+#define SPR_SPRG0	0x110
+
+static uint64_t sprg0;
+static void *page;
+
+/* The exception handlers use SPRG0, so write back the same value */
+static void h_set_sprg0_exec(void)
+{
+	hcall(H_SET_SPRG0, sprg0);
+}
+
+static bool h_page_init_prep(void)
+{
+	page = memalign(PAGE_SIZE, PAGE_SIZE);
+	return page && hcall(H_PAGE_INIT, H_ZERO_PAGE, (unsigned long)page,
+			     (unsigned long)page) == H_SUCCESS;
+}
+
+static void h_page_init_exec(void)
+{
+	hcall(H_PAGE_INIT, H_ZERO_PAGE, (unsigned long)page, (unsigned long)page);
+}
+
+static struct bench tests[] = {
+	BENCH("h_set_sprg0", h_set_sprg0_exec),
+	BENCH("h_page_init_zero", h_page_init_exec, .prep = h_page_init_prep),
+};
+
+int main(int argc, char **argv)
+{
+	sprg0 = mfspr(SPR_SPRG0);
+	bench_run_all(tests, ARRAY_SIZE(tests), argc - 1, argv + 1);
+
+	return report_summary();
+}
@@ -15,7 +15,7 @@ function usage()
 {
 cat <<EOF
 
-Usage: $0 [-h] [-v] [-a] [-g group] [-j NUM-TASKS] [-t]
+Usage: $0 [-h] [-v] [-a] [-g group] [-j NUM-TASKS] [-p CPU-LIST] [-t]
 
     -h, --help      Output this help text
     -v, --verbose   Enables verbose mode
@@ -23,6 +23,8 @@ Usage: $0 [-h] [-v] [-a] [-g group] [-j NUM-TASKS] [-t]
                     and those guarded by errata.
     -g, --group     Only execute tests in the given group
     -j, --parallel  Execute tests in parallel
+    -p, --pin       Pin the vCPUs of each test to host CPUs from the given
+                    list, e.g. 2-17; parallel tests get disjoint parts of it
     -t, --tap13     Output test results in TAP format
 
 Set the environment variable QEMU=/path/to/qemu-system-ARCH to
@@ -33,6 +35,7 @@ EOF
 
 RUNTIME_arch_run="./$TEST_DIR/run"
 source scripts/runtime.bash
+source scripts/arch-run.bash
 
 # require enhanced getopt
 getopt -T > /dev/null
@@ -42,7 +45,7 @@ if [ $? -ne 4 ]; then
 fi
 
 only_tests=""
-args=`getopt -u -o ag:htj:v -l all,group:,help,tap13,parallel:,verbose -- $*`
+args=`getopt -u -o ag:htj:p:v -l all,group:,help,tap13,parallel:,pin:,verbose -- $*`
 [ $? -ne 0 ] && exit 2;
 set -- $args;
 while [ $# -gt 0 ]; do
@@ -67,6 +70,10 @@ while [ $# -gt 0 ]; do
                 exit 2
             fi
             ;;
+        -p | --pin)
+            shift
+            pin_cpus=$1
+            ;;
         -v | --verbose)
             verbose="yes"
             ;;
@@ -133,9 +140,41 @@ RUNTIME_log_stdout () {
     fi
 }
 
+# Split the CPUs for pinning into one set per parallel task
+function pin_slots_init()
+{
+	local -a cpus
+	local size i
+
+	cpus=($(cpulist_expand $pin_cpus))
+	size=$(( ${#cpus[@]} / unittest_run_queues ))
+	if (( size == 0 )); then
+		echo "Not enough CPUs in $pin_cpus for $unittest_run_queues tasks"
+		exit 2
+	fi
+	for (( i = 0; i < unittest_run_queues; i++ )); do
+		pin_slots[i]=$(printf "%s\n" "${cpus[@]:i * size:size}" | paste -sd,)
+	done
+}
+
+# The first set of CPUs that is not used by a running task
+function pin_slot_free()
+{
+	local slot
+
+	for slot in "${!pin_slots[@]}"; do
+		if [ -z "${pin_pids[slot]}" ] ||
+		   ! jobs -pr | grep -qx "${pin_pids[slot]}"; then
+			echo $slot
+			return
+		fi
+	done
+}
+
 function run_task()
 {
 	local testname="$1"
+	local slot
 
 	while (( $(jobs | wc -l) == $unittest_run_queues )); do
 		# wait for any background test to finish
@@ -143,15 +182,21 @@ function run_task()
 	done
 
 	RUNTIME_log_file="${unittest_log_dir}/${testname}.log"
+	if [ "$pin_cpus" ]; then
+		slot=$(pin_slot_free)
+		export PIN_CPUS=${pin_slots[slot]}
+	fi
 	if [ $unittest_run_queues = 1 ]; then
 		run "$@"
 	else
 		run "$@" &
+		[ "$slot" ] && pin_pids[slot]=$!
 	fi
 }
 
 : ${unittest_log_dir:=logs}
 : ${unittest_run_queues:=1}
+: ${pin_cpus:=$PIN_CPUS}
 config=$TEST_DIR/unittests.cfg
 
 rm -rf $unittest_log_dir.old
@@ -160,6 +205,10 @@ mkdir $unittest_log_dir || exit 2
 
 echo "BUILD_HEAD=$(cat build-head)" > $unittest_log_dir/SUMMARY
 
+if [ "$pin_cpus" ]; then
+    pin_slots_init
+fi
+
 if [[ $tap_output == "yes" ]]; then
     echo "TAP version 13"
 fi
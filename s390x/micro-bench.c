@@ -0,0 +1,34 @@
+/*
+ * Measure the cost of intercepted instructions
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include <libcflat.h>
+#include <bench.h>
+#include <asm/arch_def.h>
+
+/* Handled by KVM */
+static void stidp_exec(void)
+{
+	struct cpuid id;
+
+	asm volatile ("stidp %0\n" : "=Q"(id));
+}
+
+/* Time slice end, handled by KVM with a yield */
+static void diag44_exec(void)
+{
+	asm volatile ("diag 0,0,0x44" : : : "memory");
+}
+
+static struct bench tests[] = {
+	BENCH("stidp", stidp_exec),
+	BENCH("diag44", diag44_exec),
+};
+
+int main(int argc, char **argv)
+{
+	bench_run_all(tests, ARRAY_SIZE(tests), argc - 1, argv + 1);
+
+	return report_summary();
+}
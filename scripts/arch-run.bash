@@ -26,19 +26,38 @@
 ##############################################################################
 run_qemu ()
 {
-	local stdout errors ret sig
+	local stdout errors ret sig pin_topo qmpsock pin_pid
+	local -a pin_opts
 
 	initrd_create || return $?
+	if [ "$PIN_CPUS" ] && [ "$MIGRATION" != "yes" ]; then
+		pin_topo=$(pin_check "$@") || return $?
+		qmpsock=`mktemp -u -t pin-helper-qmp.XXXXXXXXXX`
+		pin_opts=(-S -chardev socket,id=pin,path=$qmpsock,server,nowait
+			  -mon chardev=pin,mode=control)
+	fi
+	memory_backend_log
 	echo -n "$@"
 	[ "$ENVIRON_DEFAULT" = "yes" ] && echo -n " #"
-	echo " $INITRD"
+	echo " $INITRD ${pin_opts[*]}"
+
+	if [ "$qmpsock" ]; then
+		pin_vcpus $qmpsock "$pin_topo" &
+		pin_pid=$!
+	fi
 
 	# stdout to {stdout}, stderr to $errors and stderr
 	exec {stdout}>&1
-	errors=$("${@}" $INITRD </dev/null 2> >(tee /dev/stderr) > /dev/fd/$stdout)
+	errors=$("${@}" $INITRD "${pin_opts[@]}" </dev/null 2> >(tee /dev/stderr) > /dev/fd/$stdout)
 	ret=$?
 	exec {stdout}>&-
 
+	if [ "$pin_pid" ]; then
+		kill $pin_pid 2>/dev/null
+		wait $pin_pid 2>/dev/null
+		rm -f $qmpsock
+	fi
+
 	[ $ret -eq 134 ] && echo "QEMU Aborted" >&2
 
 	if [ "$errors" ]; then
@@ -92,6 +111,135 @@ run_qemu_status ()
 	return $ret
 }
 
+##############################################################################
+# run_kvmtool runs a test with kvmtool instead of QEMU.  The command is built
+# by the run script up to and including "--kernel", like for run_qemu; the
+# kernel and the QEMU-style options that follow it (from the runner and from
+# extra_params in unittests.cfg) are translated to kvmtool options.  Options
+# that kvmtool cannot honor make the test fail with "unsupported option",
+# which the runner reports as a skip.
+#
+# kvmtool has no debug-exit or chr-testdev device, so the exit status is
+# taken from the "EXIT: STATUS=" line printed by the test, with the same
+# encoding as Table1 above; without it, the status is 1 (VMM failure).
+##############################################################################
+kvmtool_translate_machine ()
+{
+	local prop
+
+	for prop in ${1//,/ }; do
+		case "$prop" in
+		virt|accel=kvm|gic-version=host)
+			;;
+		gic-version=2)
+			echo "--irqchip=gicv2"
+			;;
+		gic-version=3)
+			# QEMU's GICv3 comes with an ITS
+			echo "--irqchip=gicv3-its"
+			;;
+		*)
+			echo "kvmtool: unsupported option -machine $prop" >&2
+			return 2
+			;;
+		esac
+	done
+}
+
+run_kvmtool ()
+{
+	local -a cmd
+	local kernel stdout lines ret testret mem machine
+
+	while (( $# )); do
+		cmd+=("$1")
+		shift
+		[ "${cmd[-1]}" = "--kernel" ] && break
+	done
+	kernel=$1
+	cmd+=("$kernel")
+	shift
+
+	while (( $# )); do
+		case "$1" in
+		-smp)
+			cmd+=(--cpus "${2%%,*}")
+			;;
+		-m)
+			mem=${2%[Mm]}
+			[[ $mem = *[Gg] ]] && mem=$(( ${mem%[Gg]} * 1024 ))
+			cmd+=(--mem "$mem")
+			;;
+		-append)
+			cmd+=(--params "$2")
+			;;
+		-initrd)
+			cmd+=(--initrd "$2")
+			;;
+		-cpu)
+			# kvmtool always uses the host CPU
+			;;
+		-machine|-M)
+			machine=$(kvmtool_translate_machine "$2") || return $?
+			cmd+=($machine)
+			;;
+		*)
+			echo "kvmtool: unsupported option $1" >&2
+			return 2
+			;;
+		esac
+		shift 2
+	done
+
+	if [ ! -f "$kernel" ]; then
+		echo "kvmtool: could not open kernel $kernel" >&2
+		return 2
+	fi
+
+	if [ "$MIGRATION" = "yes" ]; then
+		echo "kvmtool: migration is not supported" >&2
+		return 2
+	fi
+
+	# kvmtool always asks for transparent huge pages, but cannot prefault
+	memory_backend_check || return $?
+	if [[ ",$MEMORY_BACKEND," = *,prealloc,* ]]; then
+		echo "kvmtool: unsupported MEMORY_BACKEND policy prealloc" >&2
+		return 2
+	fi
+	if [ "$PIN_CPUS" ]; then
+		echo "kvmtool: PIN_CPUS is not supported" >&2
+		return 2
+	fi
+	if [[ ",$MEMORY_BACKEND," = *,hugetlbfs,* ]]; then
+		cmd+=(--hugetlbfs "${HUGETLBFS_PATH:-/dev/hugepages}")
+	fi
+
+	initrd_create || return $?
+	[ -f "$KVM_UNIT_TESTS_ENV" ] && cmd+=(--initrd "$KVM_UNIT_TESTS_ENV")
+	memory_backend_log
+	echo "${cmd[@]}"
+
+	exec {stdout}>&1
+	lines=$("${cmd[@]}" </dev/null > >(tee /dev/fd/$stdout))
+	ret=$?
+	exec {stdout}>&-
+
+	# Timeouts and signals
+	[ $ret -eq 124 ] || [ $ret -gt 127 ] && return $ret
+
+	testret=$(grep '^EXIT: ' <<<"$lines" | sed 's/.*STATUS=\([0-9][0-9]*\).*/\1/')
+	if [ -z "$testret" ]; then
+		ret=1
+	elif [ $testret -eq 1 ]; then
+		ret=0
+	else
+		ret=$testret
+	fi
+
+	return $ret
+}
+
 timeout_cmd ()
 {
 	if [ "$TIMEOUT" ] && [ "$TIMEOUT" != "0" ]; then
@@ -99,68 +247,508 @@ timeout_cmd ()
 	fi
 }
 
+# Run QEMU in a transient cgroup with a memory limit, which forces the
+# host to swap guest memory (e.g. for async page fault tests)
+memory_limit_cmd ()
+{
+	if [ "$MEMORY_LIMIT" ]; then
+		echo "systemd-run --scope --quiet -p MemoryMax=$MEMORY_LIMIT --"
+	fi
+}
+
+##############################################################################
+# MEMORY_BACKEND is a comma-separated list of policies for guest RAM, so
+# that benchmarks are not at the mercy of how the host happens to back it:
+#
+# hugetlbfs - map guest RAM from hugetlbfs, mounted at $HUGETLBFS_PATH or
+#             /dev/hugepages
+# thp       - anonymous guest RAM, which QEMU asks to back with transparent
+#             huge pages; fails if THP is disabled on the host
+# prealloc  - fault in all of guest RAM before the guest starts
+#
+# The backend must have the same size as guest RAM, which is taken from
+# the -m option of the test or the default of the machine.
+##############################################################################
+memory_backend_check ()
+{
+	local policy path thp=$(memory_backend_host_thp)
+
+	for policy in ${MEMORY_BACKEND//,/ }; do
+		case "$policy" in
+		hugetlbfs)
+			path=${HUGETLBFS_PATH:-/dev/hugepages}
+			if [ "$(stat -f -c %T "$path" 2>/dev/null)" != "hugetlbfs" ]; then
+				echo "MEMORY_BACKEND=$MEMORY_BACKEND: $path is not a hugetlbfs mount" >&2
+				return 2
+			fi
+			;;
+		thp)
+			if [ "$thp" != "always" ] && [ "$thp" != "madvise" ]; then
+				echo "MEMORY_BACKEND=$MEMORY_BACKEND: THP is ${thp:-not supported} on the host" >&2
+				return 2
+			fi
+			;;
+		prealloc)
+			;;
+		*)
+			echo "MEMORY_BACKEND=$MEMORY_BACKEND: unknown policy $policy" >&2
+			return 2
+			;;
+		esac
+	done
+
+	if [[ ",$MEMORY_BACKEND," = *,hugetlbfs,* ]] &&
+	   [[ ",$MEMORY_BACKEND," = *,thp,* ]]; then
+		echo "MEMORY_BACKEND=$MEMORY_BACKEND: hugetlbfs and thp are exclusive" >&2
+		return 2
+	fi
+}
+
+memory_backend_host_thp ()
+{
+	local f=/sys/kernel/mm/transparent_hugepage/enabled
+
+	[ -r $f ] && sed 's/.*\[\(.*\)\].*/\1/' $f
+}
+
+# Guest RAM in MiB, from the last -m option in the arguments
+guest_ram_mib ()
+{
+	local mem
+
+	case "$ARCH" in
+	ppc64) mem=512 ;;
+	*) mem=128 ;;
+	esac
+
+	while (( $# )); do
+		if [ "$1" = "-m" ]; then
+			mem=${2%%,*}
+			mem=${mem#size=}
+			shift
+		fi
+		shift
+	done
+
+	case "$mem" in
+	*[0-9][Gg])
+		mem=$(( ${mem%[Gg]} * 1024 ))
+		;;
+	*[0-9][Mm])
+		mem=${mem%[Mm]}
+		;;
+	esac
+
+	if ! [[ $mem =~ ^[0-9]+$ ]]; then
+		echo "MEMORY_BACKEND=$MEMORY_BACKEND: cannot parse -m $mem" >&2
+		return 2
+	fi
+	echo $mem
+}
+
+# QEMU options for MEMORY_BACKEND, given the arguments of the test
+memory_backend_opts ()
+{
+	local mem size backend=memory-backend-ram
+	local -a nodes
+	local i
+
+	nodes=($(pin_host_nodes "$@")) || return $?
+	[ -z "$MEMORY_BACKEND" ] && (( ${#nodes[@]} < 2 )) && return
+	memory_backend_check || return $?
+	mem=$(guest_ram_mib "$@") || return $?
+
+	if [[ ",$MEMORY_BACKEND," = *,hugetlbfs,* ]]; then
+		backend="memory-backend-file,mem-path=${HUGETLBFS_PATH:-/dev/hugepages}"
+	fi
+	if [[ ",$MEMORY_BACKEND," = *,prealloc,* ]]; then
+		backend+=",prealloc=on"
+	fi
+
+	if (( ${#nodes[@]} < 2 )); then
+		echo "-object $backend,id=ram0,size=${mem}M -machine memory-backend=ram0"
+		return
+	fi
+
+	# One backend per guest NUMA node (see pin_topology_opts), bound to
+	# the host node of its vCPUs; the last one gets the remainder
+	size=$(( mem / ${#nodes[@]} / 2 * 2 ))
+	for i in "${!nodes[@]}"; do
+		(( i == ${#nodes[@]} - 1 )) && size=$(( mem - size * i ))
+		echo -n "-object $backend,id=ram$i,size=${size}M,host-nodes=${nodes[i]},policy=bind "
+	done
+}
+
+# Goes in the log, so that only runs with the same policy are compared
+memory_backend_log ()
+{
+	echo "MEMORY_BACKEND=${MEMORY_BACKEND:-default} (host THP: $(memory_backend_host_thp))"
+}
+
+##############################################################################
+# PIN_CPUS is a list of host CPUs, e.g. 4-7,12, reserved for one test.  QEMU
+# starts with the guest stopped; vCPU n is then pinned to the n-th CPU of
+# the list, the other QEMU threads to the CPUs left over (or to all of them
+# if there are none left), and the guest is started.  run_tests.sh splits
+# the list among the tests that run in parallel.
+#
+# With PIN_TOPOLOGY=yes, the vCPUs are pinned in host topology order and the
+# guest gets the sockets, cores and threads of the host CPUs that it runs
+# on, plus one NUMA node for each host node, whose memory is bound to it.
+##############################################################################
+cpulist_expand ()
+{
+	local range
+
+	for range in ${1//,/ }; do
+		seq ${range%-*} ${range#*-}
+	done
+}
+
+cpu_topology ()
+{
+	local topo=/sys/devices/system/cpu/cpu$1/topology
+	local node=$(ls -d /sys/devices/system/cpu/cpu$1/node* 2>/dev/null)
+
+	node=${node##*node}
+	echo "${node:-0} $(cat $topo/physical_package_id) $(cat $topo/core_id) $1"
+}
+
+# Number of vCPUs, from the last -smp option in the arguments
+guest_smp_cpus ()
+{
+	local smp=1
+
+	while (( $# )); do
+		if [ "$1" = "-smp" ]; then
+			smp=$2
+			shift
+		fi
+		shift
+	done
+
+	[[ ,$smp = *,cpus=* ]] && smp=${smp#*cpus=}
+	smp=${smp%%,*}
+	if ! [[ $smp =~ ^[0-9]+$ ]]; then
+		echo "PIN_CPUS=$PIN_CPUS: cannot parse -smp $smp" >&2
+		return 2
+	fi
+	echo $smp
+}
+
+# "node package core cpu" of the host CPU of each vCPU, in vCPU order
+pin_vcpu_cpus ()
+{
+	local -a cpus
+	local n cpu
+
+	n=$(guest_smp_cpus "$@") || return $?
+	cpus=($(cpulist_expand $PIN_CPUS))
+	if (( ${#cpus[@]} < n )); then
+		echo "PIN_CPUS=$PIN_CPUS has fewer CPUs than the $n vCPUs" >&2
+		return 2
+	fi
+
+	for cpu in "${cpus[@]}"; do
+		if [ ! -d /sys/devices/system/cpu/cpu$cpu ]; then
+			echo "PIN_CPUS=$PIN_CPUS: no host CPU $cpu" >&2
+			return 2
+		fi
+	done
+
+	if [ "$PIN_TOPOLOGY" = "yes" ]; then
+		for cpu in "${cpus[@]}"; do
+			cpu_topology $cpu
+		done | sort -n -k2,2 -k1,1 -k3,3 -k4,4 | head -n $n
+	else
+		for cpu in "${cpus[@]:0:$n}"; do
+			cpu_topology $cpu
+		done
+	fi
+}
+
+# Host NUMA nodes of the guest NUMA nodes, empty without PIN_TOPOLOGY
+pin_host_nodes ()
+{
+	local topo
+
+	[ "$PIN_CPUS" ] && [ "$PIN_TOPOLOGY" = "yes" ] || return 0
+	topo=$(pin_vcpu_cpus "$@") || return $?
+	awk '{ print $1 }' <<<"$topo" | uniq
+}
+
+# QEMU -smp and -numa options that match the host CPUs of the vCPUs
+pin_topology_opts ()
+{
+	local topo sockets threads n cores nodes count first=0 node=0
+
+	[ "$PIN_CPUS" ] && [ "$PIN_TOPOLOGY" = "yes" ] || return 0
+	topo=$(pin_vcpu_cpus "$@") || return $?
+	n=$(wc -l <<<"$topo")
+
+	sockets=$(awk '{ print $2 }' <<<"$topo" | sort -u | wc -l)
+	# Threads per core, and cores per socket, must be the same everywhere
+	threads=$(awk '{ print $2, $3 }' <<<"$topo" | uniq -c | awk '{ print $1 }' | sort -u)
+	cores=$(awk '{ print $2 }' <<<"$topo" | uniq -c | awk '{ print $1 }' | sort -u)
+	if [ $(wc -w <<<"$threads $cores") -ne 2 ] || (( cores % threads )); then
+		echo "PIN_TOPOLOGY: the host CPUs of the vCPUs," \
+		     $(awk '{ print $4 }' <<<"$topo") "do not form uniform sockets" >&2
+		return 2
+	fi
+	cores=$(( cores / threads ))
+	echo -n "-smp $n,sockets=$sockets,cores=$cores,threads=$threads"
+
+	nodes=$(awk '{ print $1 }' <<<"$topo" | uniq -c | awk '{ print $1 }')
+	[ $(wc -l <<<"$nodes") -gt 1 ] || return 0
+	for count in $nodes; do
+		echo -n " -numa node,nodeid=$node,cpus=$first-$((first + count - 1)),memdev=ram$node"
+		first=$((first + count))
+		node=$((node + 1))
+	done
+}
+
+# Runs in the background: pin the threads of a QEMU started with -S, then
+# start the guest.  The QEMU process is found through its vCPU threads.
+pin_vcpus ()
+{
+	local qmpsock=$1 topo=$2
+	local -a cpus tids
+	local other pid i
+
+	while [ ! -S $qmpsock ]; do
+		sleep 0.1
+	done
+
+	cpus=($(awk '{ print $4 }' <<<"$topo"))
+	tids=($(qmp $qmpsock '"query-cpus-fast"' | grep -o '"thread-id": [0-9]*' | awk '{ print $2 }'))
+	if (( ${#tids[@]} != ${#cpus[@]} )); then
+		echo "PIN_CPUS: QEMU has ${#tids[@]} vCPUs, expected ${#cpus[@]}" >&2
+		qmp $qmpsock '"quit"' > /dev/null
+		return 2
+	fi
+
+	other=$(cpulist_expand $PIN_CPUS | grep -vxF "$(printf '%s\n' "${cpus[@]}")" | paste -sd,)
+	other=${other:-$PIN_CPUS}
+	pid=$(awk '/^Tgid:/ { print $2 }' /proc/${tids[0]}/status)
+	if ! taskset -a -p -c $other $pid > /dev/null; then
+		qmp $qmpsock '"quit"' > /dev/null
+		return 2
+	fi
+	echo "PIN_CPUS: QEMU threads (pid $pid) on CPUs $other"
+
+	for i in "${!tids[@]}"; do
+		if ! taskset -p -c ${cpus[i]} ${tids[i]} > /dev/null; then
+			qmp $qmpsock '"quit"' > /dev/null
+			return 2
+		fi
+		echo "PIN_CPUS: vCPU $i (thread ${tids[i]}) on CPU ${cpus[i]}"
+	done
+
+	qmp $qmpsock '"cont"' > /dev/null
+}
+
+# Checks PIN_CPUS and prints the host CPUs of the vCPUs, for pin_vcpus
+pin_check ()
+{
+	local cmd
+
+	for cmd in ncat taskset; do
+		if ! command -v $cmd >/dev/null 2>&1; then
+			echo "PIN_CPUS needs $cmd" >&2
+			return 2
+		fi
+	done
+
+	pin_vcpu_cpus "$@"
+}
+
 qmp ()
 {
 	echo '{ "execute": "qmp_capabilities" }{ "execute":' "$2" '}' | ncat -U $1
 }
 
-run_migration ()
+##############################################################################
+# run_migration runs the test in a QEMU and, whenever the test asks for it
+# with migrate() (lib/migrate.c), migrates it to a new QEMU which then takes
+# the place of the old one, so that a test can migrate any number of times.
+#
+# Nothing is polled: the guest output, on a named pipe, is read line by line
+# until the request shows up, and each QEMU has a QMP monitor on a pair of
+# named pipes (see migration_start) that stays open for its whole life, on
+# which the runner waits for the MIGRATION and RESUME events.
+##############################################################################
+MIGRATION_REQUEST="Now migrate the VM"
+
+# Start QEMU number $1 in the background; returns after the QMP handshake
+migration_start ()
 {
-	if ! command -v ncat >/dev/null 2>&1; then
-		echo "${FUNCNAME[0]} needs ncat (netcat)" >&2
-		return 2
+	local n=$1 fd
+	shift
+
+	mkfifo $migdir/in$n $migdir/out$n $migdir/qmp$n.in $migdir/qmp$n.out
+	"$@" -chardev pipe,id=mon$n,path=$migdir/qmp$n -mon chardev=mon$n,mode=control \
+		< $migdir/in$n > $migdir/out$n &
+	migpid[n]=$!
+
+	# Opening the pipes read-write does not wait for QEMU, which may fail
+	# before it opens them; out$n is opened read-only to see EOF when QEMU
+	# exits, but the shell opens it before running QEMU
+	exec {fd}<>$migdir/in$n
+	migin[n]=$fd
+	exec {fd}<$migdir/out$n
+	migout[n]=$fd
+	exec {fd}<>$migdir/qmp$n.out
+	qmpout[n]=$fd
+	exec {fd}<>$migdir/qmp$n.in
+	qmpin[n]=$fd
+	qmpevents[n]=
+
+	# The greeting, then the capabilities negotiation
+	qmp_read $n && qmp_cmd $n '"qmp_capabilities"'
+}
+
+migration_close ()
+{
+	local n=$1 fd
+
+	for fd in ${migin[n]} ${migout[n]} ${qmpin[n]} ${qmpout[n]}; do
+		exec {fd}>&-
+	done
+	rm -f $migdir/in$n $migdir/out$n $migdir/qmp$n.in $migdir/qmp$n.out
+}
+
+# Read a QMP line from QEMU $1 into $qmpline; fails if QEMU is gone
+qmp_read ()
+{
+	local n=$1
+
+	while ! IFS= read -r -t 1 -u ${qmpout[n]} qmpline; do
+		kill -0 ${migpid[n]} 2>/dev/null || return 1
+	done
+}
+
+# Execute a QMP command, saving the events that come before the reply
+qmp_cmd ()
+{
+	local n=$1
+
+	echo '{ "execute":' "$2" '}' >&${qmpin[n]}
+	while qmp_read $n; do
+		case "$qmpline" in
+		*'"return"'*)
+			return 0
+			;;
+		*'"error"'*)
+			echo "QMP error: $qmpline" >&2
+			return 1
+			;;
+		*'"event"'*)
+			qmpevents[n]+="$qmpline"$'\n'
+			;;
+		esac
+	done
+	return 1
+}
+
+# Wait for an event of QEMU $1 matching the regex $2, into $qmpline
+qmp_wait_event ()
+{
+	local n=$1
+
+	qmpline=$(grep -E -m1 "$2" <<<"${qmpevents[n]}")
+	if [ "$qmpline" ]; then
+		qmpevents[n]=$(grep -v -F "$qmpline" <<<"${qmpevents[n]}")
+		return 0
 	fi
 
-	migsock=`mktemp -u -t mig-helper-socket.XXXXXXXXXX`
-	migout1=`mktemp -t mig-helper-stdout1.XXXXXXXXXX`
-	qmp1=`mktemp -u -t mig-helper-qmp1.XXXXXXXXXX`
-	qmp2=`mktemp -u -t mig-helper-qmp2.XXXXXXXXXX`
-	fifo=`mktemp -u -t mig-helper-fifo.XXXXXXXXXX`
-	qmpout1=/dev/null
-	qmpout2=/dev/null
+	while qmp_read $n; do
+		[[ $qmpline =~ $2 ]] && return 0
+	done
+	return 1
+}
 
-	trap 'kill 0; exit 2' INT TERM
-	trap 'rm -f ${migout1} ${migsock} ${qmp1} ${qmp2} ${fifo}' RETURN EXIT
-
-	eval "$@" -chardev socket,id=mon1,path=${qmp1},server,nowait \
-		-mon chardev=mon1,mode=control | tee ${migout1} &
-
-	# We have to use cat to open the named FIFO, because named FIFO's, unlike
-	# pipes, will block on open() until the other end is also opened, and that
-	# totally breaks QEMU...
-	mkfifo ${fifo}
-	eval "$@" -chardev socket,id=mon2,path=${qmp2},server,nowait \
-		-mon chardev=mon2,mode=control -incoming unix:${migsock} < <(cat ${fifo}) &
-	incoming_pid=`jobs -l %+ | awk '{print$2}'`
-
-	# The test must prompt the user to migrate, so wait for the "migrate" keyword
-	while ! grep -q -i "migrate" < ${migout1} ; do
-		sleep 1
+# Put the times that QEMU $1 reports for the last migration in $migstats;
+# the downtime includes saving and loading the device state, such as the
+# interrupt controller's tables
+migration_stats ()
+{
+	local n=$1 key
+
+	migstats=
+	qmp_cmd $n '"query-migrate"' || return
+	for key in setup-time downtime total-time; do
+		[[ $qmpline =~ \"$key\":\ *([0-9]+) ]] &&
+			migstats+="${migstats:+,} $key ${BASH_REMATCH[1]} ms"
+	done
+}
+
+# Copy the guest output of QEMU $1 until the test asks for a migration;
+# fails when QEMU exits
+migration_wait_request ()
+{
+	local n=$1 line
+
+	while IFS= read -r -u ${migout[n]} line; do
+		echo "$line"
+		[[ $line = *"$MIGRATION_REQUEST"* ]] && return 0
 	done
+	[ "$line" ] && echo -n "$line"
+	return 1
+}
+
+run_migration ()
+{
+	local migdir cur=0 next ret nr=0
+	local -a migpid migin migout qmpin qmpout qmpevents
+	local qmpline migstats
+
+	migdir=`mktemp -d -t mig-helper.XXXXXXXXXX`
+
+	trap 'kill 0; exit 2' INT TERM
+	trap 'rm -rf ${migdir}' RETURN EXIT
+
+	migration_start $cur "$@"
 
-	qmp ${qmp1} '"migrate", "arguments": { "uri": "unix:'${migsock}'" }' > ${qmpout1}
+	while migration_wait_request $cur; do
+		next=$((1 - cur))
+		rm -f $migdir/socket
+		if ! migration_start $next "$@" -incoming unix:$migdir/socket; then
+			echo "ERROR: Migration destination failed to start." >&2
+			qmp_cmd $cur '"quit"' > /dev/null
+			wait ${migpid[cur]} ${migpid[next]}
+			return 2
+		fi
 
-	# Wait for the migration to complete
-	migstatus=`qmp ${qmp1} '"query-migrate"' | grep return`
-	while ! grep -q '"completed"' <<<"$migstatus" ; do
-		sleep 1
-		migstatus=`qmp ${qmp1} '"query-migrate"' | grep return`
-		if grep -q '"failed"' <<<"$migstatus" ; then
+		qmp_cmd $cur '"migrate-set-capabilities", "arguments": { "capabilities": [ { "capability": "events", "state": true } ] }' &&
+		qmp_cmd $cur '"migrate", "arguments": { "uri": "unix:'$migdir/socket'" }' &&
+		qmp_wait_event $cur '"MIGRATION".*"(completed|failed)"'
+		if [[ $qmpline != *'"completed"'* ]] ||
+		   ! qmp_wait_event $next '"RESUME"'; then
 			echo "ERROR: Migration failed." >&2
-			qmp ${qmp1} '"quit"'> ${qmpout1} 2>/dev/null
-			qmp ${qmp2} '"quit"'> ${qmpout2} 2>/dev/null
+			qmp_cmd $cur '"quit"' > /dev/null
+			kill ${migpid[next]} 2>/dev/null
+			wait ${migpid[cur]} ${migpid[next]}
 			return 2
 		fi
-	done
-	qmp ${qmp1} '"quit"'> ${qmpout1} 2>/dev/null
-	echo > ${fifo}
-	wait $incoming_pid
-	ret=$?
 
-	while (( $(jobs -r | wc -l) > 0 )); do
-		sleep 0.5
+		migration_stats $cur
+
+		# The source has nothing else to say, its output ends at EOF
+		qmp_cmd $cur '"quit"' > /dev/null
+		cat <&${migout[cur]}
+		wait ${migpid[cur]}
+		migration_close $cur
+		echo "migration $((++nr)):${migstats:- no statistics}"
+
+		# Let the test continue on the destination
+		echo >&${migin[next]}
+		cur=$next
 	done
 
+	wait ${migpid[cur]}
+	ret=$?
+	migration_close $cur
+
 	return $ret
 }
 
@@ -193,6 +781,25 @@ search_qemu_binary ()
 	export PATH=$save_path
 }
 
+search_kvmtool_binary ()
+{
+	local kvmtoolcmd kvmtool
+
+	for kvmtoolcmd in ${KVMTOOL:-lkvm vm lkvm-static}; do
+		if $kvmtoolcmd --help 2>/dev/null | grep -q 'lkvm'; then
+			kvmtool="$kvmtoolcmd"
+			break
+		fi
+	done
+
+	if [ -z "$kvmtool" ]; then
+		echo "A kvmtool binary was not found." >&2
+		echo "You can set a custom location by using the KVMTOOL=<path> environment variable." >&2
+		return 2
+	fi
+	command -v $kvmtool
+}
+
 initrd_create ()
 {
 	if [ "$ENVIRON_DEFAULT" = "yes" ]; then
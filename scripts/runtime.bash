@@ -105,6 +105,11 @@ function run()
         return 2
     fi
 
+    if [ "$TARGET" = "kvmtool" ] && grep -qw "migration" <<<$groups; then
+        print_result "SKIP" $testname "" "migration not supported by kvmtool"
+        return 2
+    fi
+
     if [ -n "$accel" ] && [ -n "$ACCEL" ] && [ "$accel" != "$ACCEL" ]; then
         print_result "SKIP" $testname "" "$accel only, but ACCEL=$ACCEL"
         return 2
@@ -1,9 +1,10 @@
 /*
  * Async PF test. For the test to actually do anything it needs to be started
  * in memory cgroup with 512M of memory and with more then 1G memory provided
- * to the guest.
+ * to the guest.  With MEMORY_LIMIT=512M, the run script does this through
+ * systemd-run.
  *
- * To create cgroup do as root:
+ * Otherwise, to create cgroup do as root:
  * mkdir /dev/cgroup
  * mount -t cgroup none -omemory /dev/cgroup
  * chmod a+rxw /dev/cgroup/
@@ -13,91 +14,233 @@
  * echo $$ >  /dev/cgroup/1/tasks
  * echo 512M > /dev/cgroup/1/memory.limit_in_bytes
  *
+ * With "bench" on the command line, the test instead measures how much
+ * work the vCPU gets done while the host swaps pages in, with and without
+ * async PF.
  */
 #include "x86/msr.h"
 #include "x86/processor.h"
 #include "x86/apic-defs.h"
 #include "x86/apic.h"
+#include "x86/asyncpf.h"
 #include "x86/desc.h"
 #include "x86/isr.h"
 #include "x86/vm.h"
 
 #include "asm/page.h"
 #include "alloc.h"
+#include "bitops.h"
+#include "clock.h"
 #include "libcflat.h"
 #include "vmalloc.h"
 #include <stdint.h>
 
-#define KVM_PV_REASON_PAGE_NOT_PRESENT 1
-#define KVM_PV_REASON_PAGE_READY 2
-
-#define MSR_KVM_ASYNC_PF_EN 0x4b564d02
-
-#define KVM_ASYNC_PF_ENABLED                    (1 << 0)
-#define KVM_ASYNC_PF_SEND_ALWAYS                (1 << 1)
-
-volatile uint32_t apf_reason __attribute__((aligned(64)));
 char *buf;
 volatile uint64_t  i;
 volatile uint64_t phys;
 
-static inline uint32_t get_apf_reason(void)
+static void pf_not_present(u32 token)
 {
-	uint32_t r = apf_reason;
-	apf_reason = 0;
-	return r;
+	void* virt = (void*)((ulong)(buf+i) & ~(PAGE_SIZE-1));
+
+	phys = virt_to_pte_phys(phys_to_virt(read_cr3()), virt);
+	install_pte(phys_to_virt(read_cr3()), 1, virt, phys, 0);
+	write_cr3(read_cr3());
+	report(true,
+	       "Got not present #PF token %x virt addr %p phys addr %#" PRIx64,
+	       token, virt, phys);
+	while(phys) {
+		safe_halt(); /* enables irq */
+		irq_disable();
+	}
 }
 
-static void pf_isr(struct ex_regs *r)
+static void pf_ready(u32 token)
 {
 	void* virt = (void*)((ulong)(buf+i) & ~(PAGE_SIZE-1));
-	uint32_t reason = get_apf_reason();
-
-	switch (reason) {
-		case 0:
-			report(false, "unexpected #PF at %#lx", read_cr2());
-			break;
-		case KVM_PV_REASON_PAGE_NOT_PRESENT:
-			phys = virt_to_pte_phys(phys_to_virt(read_cr3()), virt);
-			install_pte(phys_to_virt(read_cr3()), 1, virt, phys, 0);
-			write_cr3(read_cr3());
-			report(true,
-			       "Got not present #PF token %lx virt addr %p phys addr %#" PRIx64,
-			       read_cr2(), virt, phys);
-			while(phys) {
-				safe_halt(); /* enables irq */
-				irq_disable();
+
+	report(true, "Got page ready token %x", token);
+	if (token == ~0u)
+		return;
+	install_pte(phys_to_virt(read_cr3()), 1, virt, phys | PT_PRESENT_MASK | PT_WRITABLE_MASK, 0);
+	write_cr3(read_cr3());
+	phys = 0;
+}
+
+#define MEM 1ull*1024*1024*1024
+
+/*
+ * A page access that takes longer than this is assumed to have been
+ * stalled by the host swapping the page in.
+ */
+#define STALL_NS	10000
+#define BENCH_PASSES	2
+#define WORK_ITERS	100
+#define NR_BUCKETS	32
+
+struct apf_stats {
+	u64 apf_count;
+	u64 ready_count;
+	u64 work_units;
+	u64 stalls;
+	u64 stall_ns;
+	u64 ready_ns_min, ready_ns_max, ready_ns_total;
+	u64 ready_hist[NR_BUCKETS];
+};
+
+static struct apf_stats stats;
+static volatile u32 ready_token;
+static volatile u64 ready_tsc;
+static volatile u64 work_sink;
+static u64 work_unit_ps;
+
+/* Stand-in for the guest work that async PF lets the vCPU run */
+static void do_work(void)
+{
+	u64 x = work_sink;
+	int k;
+
+	for (k = 0; k < WORK_ITERS; k++)
+		x = x * 6364136223846793005ull + 1442695040888963407ull;
+	work_sink = x;
+}
+
+static void calibrate_work(void)
+{
+	u64 t0, ns;
+	int k;
+
+	t0 = get_clock_ticks();
+	for (k = 0; k < 100000; k++)
+		do_work();
+	ns = clock_ticks_to_ns(get_clock_ticks() - t0);
+	work_unit_ps = ns * 1000 / 100000;
+}
+
+static void bench_not_present(u32 token)
+{
+	u64 t0 = get_clock_ticks(), ns;
+	unsigned int bucket;
+
+	stats.apf_count++;
+	ready_token = 0;
+
+	/* Run other work until the page is ready, instead of halting */
+	irq_enable();
+	while (ready_token != token && ready_token != ~0u) {
+		do_work();
+		stats.work_units++;
+	}
+	irq_disable();
+
+	ns = clock_ticks_to_ns(ready_tsc - t0);
+	bucket = MIN(fls(ns | 1), NR_BUCKETS - 1);
+	stats.ready_hist[bucket]++;
+	stats.ready_ns_total += ns;
+	if (!stats.ready_ns_min || ns < stats.ready_ns_min)
+		stats.ready_ns_min = ns;
+	if (ns > stats.ready_ns_max)
+		stats.ready_ns_max = ns;
+}
+
+static void bench_ready(u32 token)
+{
+	stats.ready_count++;
+	ready_tsc = get_clock_ticks();
+	ready_token = token;
+}
+
+static void run_bench(const char *name)
+{
+	u64 t0, t, start, elapsed, work_ns, pages = MEM / PAGE_SIZE * BENCH_PASSES;
+	int pass, b;
+
+	memset(&stats, 0, sizeof(stats));
+	irq_enable();
+	start = get_clock_ticks();
+	for (pass = 0; pass < BENCH_PASSES; pass++) {
+		for (i = 0; i < MEM; i += PAGE_SIZE) {
+			t0 = get_clock_ticks();
+			buf[i] = 1;
+			t = clock_ticks_to_ns(get_clock_ticks() - t0);
+			if (t > STALL_NS) {
+				stats.stalls++;
+				stats.stall_ns += t;
 			}
-			break;
-		case KVM_PV_REASON_PAGE_READY:
-			report(true, "Got present #PF token %lx", read_cr2());
-			if ((uint32_t)read_cr2() == ~0)
-				break;
-			install_pte(phys_to_virt(read_cr3()), 1, virt, phys | PT_PRESENT_MASK | PT_WRITABLE_MASK, 0);
-			write_cr3(read_cr3());
-			phys = 0;
-			break;
-		default:
-			report(false, "unexpected async pf reason %" PRId32, reason);
-			break;
+		}
 	}
+	elapsed = clock_ticks_to_ns(get_clock_ticks() - start);
+	irq_disable();
+
+	/*
+	 * Stalled accesses include the time spent in the async PF handler,
+	 * so add back the work that was done there.
+	 */
+	work_ns = stats.work_units * work_unit_ps / 1000;
+
+	printf("%s: %" PRIu64 " pages in %" PRIu64 " ms, %" PRIu64 " pages/s\n",
+	       name, pages, elapsed / 1000000, pages * 1000000000 / elapsed);
+	printf("%s: %" PRIu64 " async PFs, %" PRIu64 " page ready, %" PRIu64
+	       " stalled accesses (%" PRIu64 " ms)\n",
+	       name, stats.apf_count, stats.ready_count, stats.stalls,
+	       stats.stall_ns / 1000000);
+	printf("%s: %" PRIu64 " ms of work done while waiting, vCPU utilization %"
+	       PRIu64 "%%\n", name, work_ns / 1000000,
+	       (elapsed - MIN(stats.stall_ns, elapsed) + work_ns) * 100 / elapsed);
+
+	if (!stats.apf_count)
+		return;
+
+	printf("%s: time to ready min %" PRIu64 " avg %" PRIu64 " max %" PRIu64 " ns\n",
+	       name, stats.ready_ns_min, stats.ready_ns_total / stats.apf_count,
+	       stats.ready_ns_max);
+	for (b = 0; b < NR_BUCKETS; b++)
+		if (stats.ready_hist[b])
+			printf("%s:   < %10" PRIu64 " ns: %" PRIu64 "\n",
+			       name, (u64)2 << b, stats.ready_hist[b]);
 }
 
-#define MEM 1ull*1024*1024*1024
+static int bench(void)
+{
+	unsigned int flags = apf_int_supported() ? APF_INT : 0;
+
+	buf = malloc(MEM);
+	calibrate_work();
+
+	/* populate the buffer, so that the host starts swapping */
+	for (i = 0; i < MEM; i += PAGE_SIZE)
+		buf[i] = 1;
+
+	run_bench("apf-disabled");
+
+	if (!apf_enable(flags, bench_not_present, bench_ready)) {
+		report_skip("async PF not supported");
+		return report_summary();
+	}
+	run_bench(flags & APF_INT ? "apf-int" : "apf-pf");
+	apf_disable();
+
+	return report_summary();
+}
 
 int main(int ac, char **av)
 {
+	unsigned int flags = apf_int_supported() ? APF_INT : 0;
 	int loop = 2;
 
 	setup_vm();
-	printf("install handler\n");
-	handle_exception(14, pf_isr);
-	apf_reason = 0;
-	printf("enable async pf\n");
-	wrmsr(MSR_KVM_ASYNC_PF_EN, virt_to_phys((void*)&apf_reason) |
-			KVM_ASYNC_PF_SEND_ALWAYS | KVM_ASYNC_PF_ENABLED);
+	if (ac > 1 && !strcmp(av[1], "bench"))
+		return bench();
+
+	printf("enable async pf (%s page ready)\n",
+	       flags & APF_INT ? "interrupt-based" : "#PF-based");
+	if (!apf_enable(flags, pf_not_present, pf_ready)) {
+		report_skip("async PF not supported");
+		return report_summary();
+	}
 	printf("alloc memory\n");
-	buf = malloc(MEM);
+	/* pf_not_present() changes individual PTEs, so do not use large pages */
+	buf = vm_memalign_flags(PAGE_SIZE, MEM, VM_ALLOC_NOHUGE);
 	irq_enable();
 	while(loop--) {
 		printf("start loop\n");
@@ -107,6 +250,7 @@ int main(int ac, char **av)
 		printf("end loop\n");
 	}
 	irq_disable();
+	apf_disable();
 
 	return report_summary();
 }
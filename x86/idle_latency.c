@@ -0,0 +1,154 @@
+/*
+ * Idle wake-up latency benchmark
+ *
+ * CPU 0 halts and is woken up after a given idle time, either by an IPI
+ * from CPU 1 or by the TSC-deadline timer; the latency is the time from
+ * sending the IPI, or from the deadline, to the start of the interrupt
+ * handler.  The idle time is swept from 500 ns to 5 ms, which covers the
+ * range where KVM's halt_poll_ns and the guest's haltpoll driver decide
+ * between polling and blocking, so compare runs with different settings
+ * of those.
+ *
+ * Usage: idle_latency.flat [samples]
+ */
+#include "libcflat.h"
+#include "bench.h"
+#include "apic.h"
+#include "desc.h"
+#include "isr.h"
+#include "msr.h"
+#include "processor.h"
+#include "smp.h"
+#include "clock.h"
+#include "asm/barrier.h"
+
+#define WAKE_VECTOR		0xd1
+#define DEFAULT_SAMPLES		200
+#define MAX_SAMPLES		2000
+
+static const u64 idle_ns[] = {
+	500, 1000, 2000, 5000, 10000, 20000, 50000,
+	100000, 200000, 500000, 1000000, 2000000, 5000000,
+};
+
+static u64 lat_ns[MAX_SAMPLES];
+
+static volatile bool woken, sender_stop, sender_ready;
+static volatile u64 rx_tsc, send_tsc, halt_tsc, idle_ticks;
+static volatile unsigned int halt_seq;
+
+static void wake_handler(isr_regs_t *regs)
+{
+	rx_tsc = rdtsc();
+	woken = true;
+	eoi();
+}
+
+static void wait_for_wakeup(void)
+{
+	while (!woken) {
+		safe_halt();
+		irq_disable();
+	}
+}
+
+/* Runs on CPU 1: send an IPI once CPU 0 has been idle for idle_ticks. */
+static void ipi_sender(void *data)
+{
+	unsigned int seq = halt_seq;
+	u64 t;
+
+	sender_ready = true;
+	while (!sender_stop) {
+		if (halt_seq == seq) {
+			pause();
+			continue;
+		}
+		seq = halt_seq;
+		t = halt_tsc + idle_ticks;
+		while (rdtsc() < t)
+			pause();
+		send_tsc = rdtsc();
+		/* The x2APIC ICR write is not ordered with the store above */
+		mb();
+		apic_icr_write(APIC_INT_ASSERT | APIC_DEST_PHYSICAL |
+			       APIC_DM_FIXED | WAKE_VECTOR, id_map[0]);
+	}
+	sender_ready = false;
+}
+
+static u64 ipi_wakeup(void)
+{
+	irq_disable();
+	woken = false;
+	halt_tsc = rdtsc();
+	halt_seq++;
+	wait_for_wakeup();
+	return rx_tsc - send_tsc;
+}
+
+static u64 timer_wakeup(void)
+{
+	u64 deadline;
+
+	irq_disable();
+	woken = false;
+	deadline = rdtsc() + idle_ticks;
+	wrmsr(MSR_IA32_TSCDEADLINE, deadline);
+	wait_for_wakeup();
+	return rx_tsc - deadline;
+}
+
+static void sweep(const char *name, u64 (*wakeup)(void), int samples)
+{
+	int i, n;
+
+	for (i = 0; i < ARRAY_SIZE(idle_ns); i++) {
+		idle_ticks = get_clock_hz() * idle_ns[i] / NSEC_PER_SEC;
+		for (n = 0; n < samples; n++) {
+			u64 ticks = wakeup();
+
+			/* The deadline may already have passed before HLT */
+			lat_ns[n] = (s64)ticks > 0 ? clock_ticks_to_ns(ticks) : 0;
+		}
+		printf("%-6s %10" PRIu64, name, idle_ns[i]);
+		bench_print_percentiles(lat_ns, samples);
+	}
+}
+
+int main(int ac, char **av)
+{
+	int samples = ac > 1 ? atol(av[1]) : DEFAULT_SAMPLES;
+
+	samples = MAX(1, MIN(samples, MAX_SAMPLES));
+	mask_pic_interrupts();
+	handle_irq(WAKE_VECTOR, wake_handler);
+
+	printf("%d samples per point, wake-up latency in ns\n", samples);
+	printf("%-6s %10s", "event", "idle ns");
+	bench_print_percentiles_header();
+
+	if (cpu_count() > 1) {
+		on_cpu_async(1, ipi_sender, NULL);
+		while (!sender_ready)
+			pause();
+		sweep("ipi", ipi_wakeup, samples);
+		sender_stop = true;
+		while (sender_ready)
+			pause();
+		report(true, "IPI wake-up");
+	} else {
+		report_skip("IPI wake-up needs at least two CPUs");
+	}
+
+	if (this_cpu_has(X86_FEATURE_TSC_DEADLINE_TIMER)) {
+		apic_write(APIC_LVTT, APIC_LVT_TIMER_TSCDEADLINE | WAKE_VECTOR);
+		sweep("timer", timer_wakeup, samples);
+		apic_write(APIC_LVTT, APIC_LVT_MASKED);
+		report(true, "TSC-deadline timer wake-up");
+	} else {
+		report_skip("TSC-deadline timer not supported");
+	}
+
+	return report_summary();
+}
@@ -1,5 +1,6 @@
 #include "libcflat.h"
 #include "apic.h"
+#include "rtc.h"
 #include "asm/io.h"
 
 #define KBD_CCMD_READ_OUTPORT   0xD0    /* read output port */
@@ -26,12 +27,6 @@ static inline void kbd_out(u8 val)
     outb(val, 0x60);
 }
 
-static inline void rtc_out(u8 reg, u8 val)
-{
-    outb(reg, 0x70);
-    outb(val, 0x71);
-}
-
 extern char resume_start, resume_end;
 
 #define state (*(volatile int *)0x2000)
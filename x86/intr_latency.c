@@ -0,0 +1,257 @@
+/*
+ * Interrupt delivery latency benchmark
+ *
+ * Measures the time from sending an interrupt on CPU 0 to the start of
+ * the handler on CPU 1, for IPIs and for IOAPIC interrupts raised through
+ * pc-testdev, while CPU 1 spins with interrupts enabled or sits in HLT.
+ * Samples where KVM reports CPU 1 as preempted (through the steal time
+ * area) are accounted separately as "scheduled-out"; to get some, run the
+ * vCPU threads on fewer host CPUs than there are vCPUs.
+ *
+ * APICv and AVIC cannot be toggled from inside the guest; compare runs
+ * with kvm_intel.enable_apicv or kvm_amd.avic set to 0 and 1 on the host.
+ *
+ * Exits are counted from gaps in the TSC: the sender times the ICR or
+ * I/O port write, the target times its EOI and, while spinning, the gap
+ * between its last TSC read and the entry of the handler.  Anything that
+ * takes longer than the threshold counts as one exit.  The HLT exit of a
+ * halted target is not counted.
+ *
+ * Usage: intr_latency.flat [samples [threshold_ns]]
+ */
+#include "libcflat.h"
+#include "bitops.h"
+#include "apic.h"
+#include "desc.h"
+#include "isr.h"
+#include "msr.h"
+#include "processor.h"
+#include "smp.h"
+#include "x86/kvm_para.h"
+#include "clock.h"
+
+#define INTR_VECTOR		0xd0
+#define TESTDEV_IRQ		0x0e
+#define TARGET_CPU		1
+#define DEFAULT_SAMPLES		10000
+#define DEFAULT_THRESHOLD_NS	300
+#define SETTLE_NS		20000
+#define NR_BUCKETS		24
+
+enum intr_source { SRC_IPI, SRC_IOAPIC, NR_SOURCES };
+enum target_state { TARGET_RUNNING, TARGET_HALTED, TARGET_PREEMPTED, NR_STATES };
+
+static const char *source_names[NR_SOURCES] = { "ipi", "ioapic" };
+static const char *state_names[NR_STATES] = { "running", "halted", "scheduled-out" };
+
+struct lat_stats {
+	u64 count;
+	u64 ns_min, ns_max, ns_total;
+	u64 sender_exits, delivery_exits, eoi_exits;
+	u64 hist[NR_BUCKETS];
+};
+
+static struct lat_stats stats[NR_SOURCES][NR_STATES];
+
+static u64 gap_ticks;
+static volatile bool target_halt, target_stop, target_ready;
+static volatile u64 loop_tsc, rx_tsc, stray_gaps;
+static volatile unsigned int rx_count;
+static volatile bool rx_delivery_exit, rx_eoi_exit;
+
+static void intr_handler(isr_regs_t *regs)
+{
+	u64 t = rdtsc(), t0;
+
+	rx_tsc = t;
+	rx_delivery_exit = !target_halt && (s64)(t - loop_tsc) > (s64)gap_ticks;
+
+	t0 = rdtsc();
+	eoi();
+	t = rdtsc();
+	rx_eoi_exit = t - t0 > gap_ticks;
+
+	/* Do not count the time spent in the handler as a gap */
+	loop_tsc = t;
+	rx_count++;
+}
+
+static void target_loop(void *data)
+{
+	u64 now;
+
+	steal_time_enable();
+	irq_enable();
+	loop_tsc = rdtsc();
+	target_ready = true;
+
+	while (!target_stop) {
+		if (target_halt) {
+			safe_halt();
+			continue;
+		}
+		now = rdtsc();
+		if ((s64)(now - loop_tsc) > (s64)gap_ticks)
+			stray_gaps++;
+		loop_tsc = now;
+	}
+
+	irq_disable();
+	steal_time_disable();
+	target_ready = false;
+}
+
+static void account(struct lat_stats *s, u64 ns, bool sender_exit)
+{
+	s->count++;
+	s->ns_total += ns;
+	if (!s->ns_min || ns < s->ns_min)
+		s->ns_min = ns;
+	if (ns > s->ns_max)
+		s->ns_max = ns;
+	s->hist[MIN(fls(ns | 1), NR_BUCKETS - 1)]++;
+	s->sender_exits += sender_exit;
+	s->delivery_exits += rx_delivery_exit;
+	s->eoi_exits += rx_eoi_exit;
+}
+
+static bool measure(enum intr_source src, bool halt, int samples)
+{
+	u64 timeout = get_clock_hz(), settle = get_clock_hz() * SETTLE_NS / NSEC_PER_SEC;
+	u64 t0, t, lcg = 1;
+	unsigned int seq;
+	bool preempted, sender_exit;
+	enum target_state state;
+	int n;
+
+	target_halt = halt;
+	for (n = 0; n < samples; n++) {
+		/* Give the target a random amount of time to spin or halt again */
+		lcg = lcg * 6364136223846793005ull + 1442695040888963407ull;
+		t = rdtsc() + settle + (lcg >> 33) % settle;
+		while (rdtsc() < t)
+			pause();
+
+		seq = rx_count;
+		preempted = steal_time_preempted(TARGET_CPU);
+		t0 = rdtsc();
+		if (src == SRC_IPI)
+			apic_icr_write(APIC_INT_ASSERT | APIC_DEST_PHYSICAL |
+				       APIC_DM_FIXED | INTR_VECTOR,
+				       id_map[TARGET_CPU]);
+		else
+			set_irq_line(TESTDEV_IRQ, 1);
+		t = rdtsc();
+		sender_exit = t - t0 > gap_ticks;
+		if (src == SRC_IOAPIC)
+			set_irq_line(TESTDEV_IRQ, 0);
+
+		while (rx_count == seq) {
+			if (rdtsc() - t > timeout)
+				return false;
+			pause();
+		}
+
+		state = preempted ? TARGET_PREEMPTED :
+			halt ? TARGET_HALTED : TARGET_RUNNING;
+		account(&stats[src][state],
+			(s64)(rx_tsc - t0) > 0 ? clock_ticks_to_ns(rx_tsc - t0) : 0,
+			sender_exit);
+	}
+	return true;
+}
+
+static void print_hundredths(const char *label, u64 n, u64 count)
+{
+	u64 x = n * 100 / count;
+
+	printf(" %s %" PRIu64 ".%02" PRIu64, label, x / 100, x % 100);
+}
+
+static void print_stats(enum intr_source src, enum target_state state)
+{
+	struct lat_stats *s = &stats[src][state];
+	const char *name = source_names[src], *sname = state_names[state];
+	int b;
+
+	if (!s->count) {
+		printf("%s %s: no samples\n", name, sname);
+		return;
+	}
+
+	printf("%s %s: %" PRIu64 " samples, latency min %" PRIu64 " avg %"
+	       PRIu64 " max %" PRIu64 " ns\n", name, sname, s->count,
+	       s->ns_min, s->ns_total / s->count, s->ns_max);
+	printf("%s %s:", name, sname);
+	print_hundredths("exits/intr", s->sender_exits + s->delivery_exits +
+			 s->eoi_exits, s->count);
+	print_hundredths("(sender", s->sender_exits, s->count);
+	print_hundredths("delivery", s->delivery_exits, s->count);
+	print_hundredths("eoi", s->eoi_exits, s->count);
+	printf(")\n");
+	for (b = 0; b < NR_BUCKETS; b++)
+		if (s->hist[b])
+			printf("%s %s:   < %10" PRIu64 " ns: %" PRIu64 "\n",
+			       name, sname, (u64)2 << b, s->hist[b]);
+}
+
+int main(int ac, char **av)
+{
+	int samples = ac > 1 ? atol(av[1]) : DEFAULT_SAMPLES;
+	u64 threshold_ns = ac > 2 ? atol(av[2]) : DEFAULT_THRESHOLD_NS;
+	ioapic_redir_entry_t e = {
+		.vector = INTR_VECTOR,
+		.dest_id = id_map[TARGET_CPU],
+	};
+	u64 t0, spin_ns;
+	int src, state;
+	bool ok;
+
+	if (cpu_count() < 2) {
+		report_skip("intr_latency needs at least two CPUs");
+		return report_summary();
+	}
+
+	mask_pic_interrupts();
+	handle_irq(INTR_VECTOR, intr_handler);
+	ioapic_write_redir(TESTDEV_IRQ, e);
+
+	gap_ticks = get_clock_hz() * threshold_ns / NSEC_PER_SEC;
+	printf("%s mode, %d samples per case, exit threshold %" PRIu64 " ns\n",
+	       rdmsr(MSR_IA32_APICBASE) & APIC_EXTD ? "x2APIC" : "xAPIC",
+	       samples, threshold_ns);
+	if (!kvm_has_feature(KVM_FEATURE_STEAL_TIME))
+		printf("no steal time, cannot detect a scheduled-out target\n");
+
+	on_cpu_async(TARGET_CPU, target_loop, NULL);
+	while (!target_ready)
+		pause();
+
+	for (src = 0; src < NR_SOURCES; src++) {
+		stray_gaps = 0;
+		t0 = rdtsc();
+		ok = measure(src, false, samples);
+		spin_ns = clock_ticks_to_ns(rdtsc() - t0);
+		report(ok, "%s interrupts to a running target", source_names[src]);
+		printf("%s running: %" PRIu64 " background exits per second\n",
+		       source_names[src], (u64)(stray_gaps * NSEC_PER_SEC / spin_ns));
+
+		ok = measure(src, true, samples);
+		report(ok, "%s interrupts to a halted target", source_names[src]);
+	}
+
+	/* Wake up the target so that it sees target_stop */
+	target_halt = false;
+	target_stop = true;
+	apic_icr_write(APIC_INT_ASSERT | APIC_DEST_PHYSICAL | APIC_DM_FIXED |
+		       INTR_VECTOR, id_map[TARGET_CPU]);
+	while (target_ready)
+		pause();
+	set_mask(TESTDEV_IRQ, true);
+
+	for (src = 0; src < NR_SOURCES; src++)
+		for (state = 0; state < NR_STATES; state++)
+			print_stats(src, state);
+
+	return report_summary();
+}
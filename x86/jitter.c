@@ -0,0 +1,324 @@
+/*
+ * vCPU noise detector
+ *
+ * Every CPU spins reading the clock of asm/time.h (the TSC on x86, the
+ * virtual counter on arm64, the TOD clock on s390x) with interrupts
+ * disabled, for the same period of time, and records each gap between
+ * two reads that is longer than a threshold: such a gap is time taken
+ * away from the vCPU by the host, e.g. by host interrupts, by exits or by
+ * the vCPU thread being scheduled out.  The gaps are summarized per CPU,
+ * as a histogram of their duration, as a timeline and as a list of the
+ * longest ones.
+ *
+ * On x86, if KVM provides steal time, the steal time of each CPU is read
+ * after every gap, so that the gaps caused by the vCPU being preempted
+ * can be told apart from the others.
+ *
+ * With max_gap_ns, the test fails if any gap is longer than that, which
+ * can be used to validate a host with isolated CPUs.
+ *
+ * Usage: jitter.flat [duration_ms [threshold_ns [max_gap_ns]]]
+ */
+#include "libcflat.h"
+#include "bitops.h"
+#include "clock.h"
+
+#if defined(__x86_64__)
+#include "apic-defs.h"
+#include "processor.h"
+#include "smp.h"
+#include "x86/kvm_para.h"
+#define JITTER_MAX_CPUS		MAX_TEST_CPUS
+#define jitter_nr_cpus()	cpu_count()
+#define jitter_cpu_id()		smp_id()
+#define jitter_irq_disable()	irq_disable()
+#define jitter_relax()		pause()
+#define jitter_on_cpus(func)	on_cpus(func, NULL)
+#define jitter_has_steal()	kvm_has_feature(KVM_FEATURE_STEAL_TIME)
+#define jitter_steal_enable()	steal_time_enable()
+#define jitter_steal_ns(cpu)	steal_time_ns(cpu)
+#define jitter_steal_disable()	steal_time_disable()
+#elif defined(__aarch64__)
+#include <asm/processor.h>
+#include <asm/setup.h>
+#include <asm/smp.h>
+#define JITTER_MAX_CPUS		NR_CPUS
+#define jitter_nr_cpus()	nr_cpus
+#define jitter_cpu_id()		smp_processor_id()
+#define jitter_irq_disable()	local_irq_disable()
+#define jitter_relax()		cpu_relax()
+#define jitter_on_cpus(func)	on_cpus(func, NULL)
+#elif defined(__s390x__)
+#include <asm/arch_def.h>
+#include <asm/barrier.h>
+#include <smp.h>
+#define JITTER_MAX_CPUS		64
+#define jitter_nr_cpus()	smp_query_num_cpus()
+/* QEMU numbers the CPU addresses from 0 */
+#define jitter_cpu_id()		stap()
+#define jitter_irq_disable()	load_psw_mask(extract_psw_mask() & \
+					      ~(PSW_MASK_EXT | PSW_MASK_IO))
+#define jitter_relax()		mb()
+static void jitter_on_cpus(void (*func)(void *data));
+#endif
+
+#ifndef jitter_has_steal
+#define jitter_has_steal()	false
+#define jitter_steal_enable()	false
+#define jitter_steal_ns(cpu)	0
+#define jitter_steal_disable()	do { } while (0)
+#endif
+
+#define DEFAULT_DURATION_MS	1000
+#define DEFAULT_THRESHOLD_NS	1000
+#define START_DELAY_MS		10
+#define NR_BUCKETS		32
+#define NR_SLOTS		64
+#define MAX_SAVED_GAPS		512
+#define NR_LONGEST		5
+
+struct gap {
+	u64 start;
+	u64 ticks;
+};
+
+struct jitter_cpu {
+	bool has_steal;
+	u64 loops;
+	u64 nr_gaps, gap_ticks, max_ticks;
+	u64 steal_ns, steal_gaps, steal_in_gaps_ns;
+	u64 hist[NR_BUCKETS];
+	u64 slot_ticks[NR_SLOTS];
+	int nr_saved;
+	struct gap saved[MAX_SAVED_GAPS];
+};
+
+static struct jitter_cpu jitter[JITTER_MAX_CPUS];
+static u64 start_ticks, duration_ticks, threshold_ticks;
+
+static void record_gap(struct jitter_cpu *c, u64 start, u64 ticks)
+{
+	u64 slot = start * NR_SLOTS / duration_ticks;
+
+	c->nr_gaps++;
+	c->gap_ticks += ticks;
+	c->max_ticks = MAX(c->max_ticks, ticks);
+	c->hist[MIN(fls(clock_ticks_to_ns(ticks) | 1), NR_BUCKETS - 1)]++;
+	c->slot_ticks[MIN(slot, NR_SLOTS - 1)] += ticks;
+	if (c->nr_saved < MAX_SAVED_GAPS)
+		c->saved[c->nr_saved++] = (struct gap) { start, ticks };
+}
+
+static void jitter_loop(void *data)
+{
+	int cpu = jitter_cpu_id();
+	struct jitter_cpu *c = &jitter[cpu];
+	u64 end = start_ticks + duration_ticks;
+	u64 last, now, steal0 = 0, steal = 0, t;
+
+	jitter_irq_disable();
+	c->has_steal = jitter_steal_enable();
+	if (c->has_steal)
+		steal = steal0 = jitter_steal_ns(cpu);
+
+	while ((now = get_clock_ticks()) < start_ticks)
+		jitter_relax();
+
+	for (last = now; now < end; last = now) {
+		now = get_clock_ticks();
+		c->loops++;
+		if (now - last <= threshold_ticks)
+			continue;
+
+		record_gap(c, last - start_ticks, now - last);
+		if (c->has_steal) {
+			t = jitter_steal_ns(cpu);
+			if (t != steal) {
+				c->steal_gaps++;
+				c->steal_in_gaps_ns += t - steal;
+				steal = t;
+			}
+		}
+		/* Do not count the bookkeeping as part of the next gap */
+		now = get_clock_ticks();
+	}
+
+	if (c->has_steal) {
+		c->steal_ns = jitter_steal_ns(cpu) - steal0;
+		jitter_steal_disable();
+	}
+}
+
+#ifdef __s390x__
+static void (*secondary_func)(void *data);
+static volatile bool secondary_done[JITTER_MAX_CPUS];
+
+static void jitter_secondary(void)
+{
+	secondary_func(NULL);
+	mb();
+	secondary_done[stap()] = true;
+}
+
+/* There is no on_cpus(), start the other CPUs directly */
+static void jitter_on_cpus(void (*func)(void *data))
+{
+	struct psw psw = {
+		.mask = extract_psw_mask(),
+		.addr = (unsigned long)jitter_secondary,
+	};
+	int nr = MIN(jitter_nr_cpus(), JITTER_MAX_CPUS);
+	uint16_t me = stap(), addr;
+
+	secondary_func = func;
+	for (addr = 0; addr < nr; addr++)
+		if (addr != me)
+			smp_cpu_setup(addr, psw);
+
+	func(NULL);
+
+	for (addr = 0; addr < nr; addr++) {
+		if (addr == me)
+			continue;
+		while (!secondary_done[addr])
+			mb();
+		smp_cpu_stop(addr);
+	}
+}
+#endif
+
+static void print_hundredths(const char *label, u64 n, u64 total)
+{
+	u64 x = total ? n * 10000 / total : 0;
+
+	printf(" %s %" PRIu64 ".%02" PRIu64 "%%", label, x / 100, x % 100);
+}
+
+static void print_summary(int cpu)
+{
+	struct jitter_cpu *c = &jitter[cpu];
+
+	printf("cpu%d: %" PRIu64 " loops, %" PRIu64 " gaps, max %" PRIu64
+	       " ns,", cpu, c->loops, c->nr_gaps,
+	       clock_ticks_to_ns(c->max_ticks));
+	print_hundredths("lost", c->gap_ticks, duration_ticks);
+	printf("\n");
+	if (c->has_steal)
+		printf("cpu%d: steal %" PRIu64 " ns, %" PRIu64 " ns of it in %"
+		       PRIu64 " gaps\n", cpu, c->steal_ns, c->steal_in_gaps_ns,
+		       c->steal_gaps);
+}
+
+static void print_histogram(int nr)
+{
+	u64 n;
+	int b, cpu;
+
+	printf("gap duration histogram:\n");
+	printf("%12s", "ns");
+	for (cpu = 0; cpu < nr; cpu++)
+		printf(" %7s%-3d", "cpu", cpu);
+	printf("\n");
+
+	for (b = 0; b < NR_BUCKETS; b++) {
+		for (n = 0, cpu = 0; cpu < nr; cpu++)
+			n += jitter[cpu].hist[b];
+		if (!n)
+			continue;
+		printf("< %10" PRIu64, (u64)2 << b);
+		for (cpu = 0; cpu < nr; cpu++)
+			printf(" %10" PRIu64, jitter[cpu].hist[b]);
+		printf("\n");
+	}
+}
+
+/*
+ * One character per slot: '.' if there was no gap, otherwise the tenths
+ * of the slot that were lost to gaps, with '#' for all of it.
+ */
+static void print_timeline(int nr)
+{
+	u64 slot_ticks = duration_ticks / NR_SLOTS, tenths;
+	char line[NR_SLOTS + 1];
+	int cpu, i;
+
+	printf("timeline, %" PRIu64 " us per column:\n",
+	       clock_ticks_to_ns(slot_ticks) / 1000);
+	for (cpu = 0; cpu < nr; cpu++) {
+		for (i = 0; i < NR_SLOTS; i++) {
+			tenths = jitter[cpu].slot_ticks[i] * 10 / slot_ticks;
+			if (!jitter[cpu].slot_ticks[i])
+				line[i] = '.';
+			else if (tenths >= 10)
+				line[i] = '#';
+			else
+				line[i] = '0' + tenths;
+		}
+		line[NR_SLOTS] = '\0';
+		printf("cpu%-3d |%s|\n", cpu, line);
+	}
+}
+
+static void print_longest(int cpu)
+{
+	struct jitter_cpu *c = &jitter[cpu];
+	bool printed[MAX_SAVED_GAPS] = {};
+	int i, n, max;
+
+	for (n = 0; n < NR_LONGEST; n++) {
+		max = -1;
+		for (i = 0; i < c->nr_saved; i++)
+			if (!printed[i] &&
+			    (max < 0 || c->saved[i].ticks > c->saved[max].ticks))
+				max = i;
+		if (max < 0)
+			break;
+		printed[max] = true;
+		printf("cpu%d: gap of %" PRIu64 " ns at %" PRIu64 " us\n", cpu,
+		       clock_ticks_to_ns(c->saved[max].ticks),
+		       clock_ticks_to_ns(c->saved[max].start) / 1000);
+	}
+	if (c->nr_saved < c->nr_gaps)
+		printf("cpu%d: only the first %d gaps were saved\n", cpu,
+		       c->nr_saved);
+}
+
+int main(int ac, char **av)
+{
+	u64 duration_ms = ac > 1 ? atol(av[1]) : DEFAULT_DURATION_MS;
+	u64 threshold_ns = ac > 2 ? atol(av[2]) : DEFAULT_THRESHOLD_NS;
+	u64 max_gap_ns = ac > 3 ? atol(av[3]) : 0;
+	int nr = MIN(jitter_nr_cpus(), JITTER_MAX_CPUS), cpu;
+
+	duration_ms = MAX(duration_ms, 1);
+	duration_ticks = get_clock_hz() * duration_ms / 1000;
+	threshold_ticks = get_clock_hz() * threshold_ns / NSEC_PER_SEC;
+
+	printf("%d CPUs, %" PRIu64 " ms, threshold %" PRIu64 " ns, %s\n",
+	       nr, duration_ms, threshold_ns,
+	       jitter_has_steal() ? "steal time" : "no steal time");
+
+	/* Start all CPUs at the same time, so that the timelines line up */
+	start_ticks = get_clock_ticks() + get_clock_hz() * START_DELAY_MS / 1000;
+	jitter_on_cpus(jitter_loop);
+
+	for (cpu = 0; cpu < nr; cpu++)
+		print_summary(cpu);
+	print_histogram(nr);
+	print_timeline(nr);
+	for (cpu = 0; cpu < nr; cpu++)
+		print_longest(cpu);
+
+	for (cpu = 0; cpu < nr; cpu++) {
+		u64 max_ns = clock_ticks_to_ns(jitter[cpu].max_ticks);
+
+		if (max_gap_ns)
+			report(max_ns <= max_gap_ns,
+			       "cpu%d: longest gap %" PRIu64 " ns <= %" PRIu64 " ns",
+			       cpu, max_ns, max_gap_ns);
+		else
+			report(jitter[cpu].loops, "cpu%d: noise measured", cpu);
+	}
+
+	return report_summary();
+}
@@ -0,0 +1,82 @@
+/*
+ * kvmclock across migrations
+ *
+ * Migrates the VM the given number of times and checks that kvmclock,
+ * with the TSC stable bit trusted as in the monotonic test of
+ * kvmclock_test, never goes backwards across a migration: after each
+ * migration, every CPU must read a later time than any CPU read before
+ * it.  The jump of the clock across a migration, i.e. the downtime seen
+ * by the guest, is printed too.
+ *
+ * Usage: kvmclock_migration.flat [migrations]
+ */
+#include "libcflat.h"
+#include "migrate.h"
+#include "processor.h"
+#include "smp.h"
+#include "x86/kvm_para.h"
+#include "kvmclock.h"
+
+#define DEFAULT_MIGRATIONS	10
+
+static u64 before[MAX_CPU], after[MAX_CPU];
+
+static void read_before(void *data)
+{
+	before[smp_id()] = kvm_clock_read();
+}
+
+static void read_after(void *data)
+{
+	after[smp_id()] = kvm_clock_read();
+}
+
+int main(int ac, char **av)
+{
+	int migrations, ncpus = cpu_count(), backwards = 0;
+	u64 latest, jump, max_jump = 0, total_jump = 0;
+	int i, cpu;
+
+	migrations = ac > 1 ? atol(av[1]) : DEFAULT_MIGRATIONS;
+	migrations = MAX(migrations, 1);
+
+	if (!kvm_has_feature(KVM_FEATURE_CLOCKSOURCE2)) {
+		report_skip("kvmclock not supported");
+		return report_summary();
+	}
+	if (ncpus > MAX_CPU)
+		report_abort("number cpus exceeds %d", MAX_CPU);
+
+	on_cpus(kvm_clock_init, NULL);
+	pvclock_set_flags(PVCLOCK_TSC_STABLE_BIT);
+
+	for (i = 0; i < migrations; i++) {
+		on_cpus(read_before, NULL);
+		migrate_quiet();
+		on_cpus(read_after, NULL);
+
+		latest = 0;
+		for (cpu = 0; cpu < ncpus; cpu++)
+			latest = MAX(latest, before[cpu]);
+		for (cpu = 0; cpu < ncpus; cpu++) {
+			if (after[cpu] >= latest)
+				continue;
+			printf("migration %d: CPU %d went back by %" PRIu64 " ns\n",
+			       i + 1, cpu, latest - after[cpu]);
+			backwards++;
+		}
+
+		jump = after[0] > before[0] ? after[0] - before[0] : 0;
+		max_jump = MAX(max_jump, jump);
+		total_jump += jump;
+	}
+
+	on_cpus(kvm_clock_clear, NULL);
+
+	printf("clock jump across a migration: avg %" PRIu64 " max %" PRIu64
+	       " us\n", total_jump / migrations / 1000, max_jump / 1000);
+	report(!backwards, "kvmclock monotonic across %d migrations, %d CPUs",
+	       migrations, ncpus);
+
+	return report_summary();
+}
@@ -0,0 +1,285 @@
+/*
+ * MSR access cost matrix
+ *
+ * Times RDMSR and WRMSR for a list of MSRs that a guest kernel uses,
+ * skipping those that raise #GP.  Writes store back the value that was
+ * read, except for the write-only MSRs, which get a harmless command, and
+ * for the rows that toggle a bit, e.g. IBRS in SPEC_CTRL like a context
+ * switch between tasks with different mitigations.  KVM passes SPEC_CTRL
+ * through only after the guest writes a nonzero value, so the plain
+ * SPEC_CTRL row, which comes first, shows the cost before that happens.
+ *
+ * Each access is classified by its cost, relative to CPUID, which KVM
+ * always handles in the kernel, and to an I/O port that QEMU handles in
+ * userspace: "passthrough" if it costs less than half a CPUID exit,
+ * "userspace" if it is closer to the userspace exit, for example because
+ * of an MSR filter, and "kernel" otherwise.  MSRs whose emulation does
+ * real work, such as FLUSH_CMD, can end up in a slower class than the
+ * one that handles them.
+ *
+ * The accesses are timed by the benchmark harness, "rdmsr" and "wrmsr"
+ * have one variant per MSR.
+ *
+ * Usage: msr_cost.flat [benchmark globs...]
+ */
+#include "libcflat.h"
+#include "bench.h"
+#include "apic.h"
+#include "asm/io.h"
+#include "desc.h"
+#include "msr.h"
+#include "processor.h"
+#include "x86/kvm_para.h"
+
+#define USERSPACE_PORT		0x1234
+
+#define X2APIC_MSR(reg)		(APIC_BASE_MSR + ((reg) >> 4))
+
+/* Do not write the MSR */
+#define MSR_RO			(1 << 0)
+/* Write wr_val, the MSR cannot be read or reading it is irrelevant */
+#define MSR_WO			(1 << 1)
+
+struct msr_cost {
+	u32 index;
+	const char *name;
+	unsigned int flags;
+	u64 wr_val;
+	/* Writes alternate between the value read and value ^ toggle */
+	u64 toggle;
+};
+
+static struct msr_cost msrs[] = {
+	{ MSR_IA32_TSC, "TSC", MSR_RO },
+	{ MSR_IA32_APICBASE, "APIC_BASE" },
+	{ MSR_CORE_THREAD_COUNT, "CORE_THREAD_COUNT", MSR_RO },
+	{ MSR_IA32_FEATURE_CONTROL, "FEATURE_CONTROL", MSR_RO },
+	{ MSR_IA32_TSC_ADJUST, "TSC_ADJUST" },
+	{ MSR_IA32_SPEC_CTRL, "SPEC_CTRL" },
+	{ MSR_IA32_SPEC_CTRL, "SPEC_CTRL ^ IBRS", .toggle = 1 },
+	{ MSR_IA32_PRED_CMD, "PRED_CMD (IBPB)", MSR_WO, .wr_val = 1 },
+	{ MSR_IA32_FLUSH_CMD, "FLUSH_CMD (L1D)", MSR_WO, .wr_val = 1 },
+	{ MSR_AMD64_VIRT_SPEC_CTRL, "VIRT_SPEC_CTRL" },
+	{ MSR_IA32_UCODE_REV, "UCODE_REV", MSR_RO },
+	{ MSR_IA32_ARCH_CAPABILITIES, "ARCH_CAPABILITIES", MSR_RO },
+	{ MSR_IA32_TSX_CTRL, "TSX_CTRL" },
+	{ MSR_IA32_SYSENTER_CS, "SYSENTER_CS" },
+	{ MSR_IA32_SYSENTER_ESP, "SYSENTER_ESP" },
+	{ MSR_IA32_SYSENTER_EIP, "SYSENTER_EIP" },
+	{ MSR_IA32_MISC_ENABLE, "MISC_ENABLE" },
+	{ MSR_IA32_DEBUGCTLMSR, "DEBUGCTL" },
+	{ MSR_IA32_CR_PAT, "PAT" },
+	{ MSR_MTRRdefType, "MTRR_DEF_TYPE" },
+	{ MSR_IA32_XSS, "XSS" },
+	{ MSR_P6_PERFCTR0, "PERFCTR0" },
+	{ MSR_P6_EVNTSEL0, "EVNTSEL0" },
+	{ MSR_CORE_PERF_GLOBAL_CTRL, "PERF_GLOBAL_CTRL" },
+	{ MSR_IA32_TSCDEADLINE, "TSC_DEADLINE" },
+	{ X2APIC_MSR(APIC_ID), "x2APIC ID", MSR_RO },
+	{ X2APIC_MSR(APIC_TASKPRI), "x2APIC TPR" },
+	{ X2APIC_MSR(APIC_EOI), "x2APIC EOI", MSR_WO, .wr_val = 0 },
+	{ X2APIC_MSR(APIC_TMICT), "x2APIC TMICT" },
+	{ X2APIC_MSR(APIC_TMCCT), "x2APIC TMCCT", MSR_RO },
+	{ MSR_EFER, "EFER" },
+	{ MSR_STAR, "STAR" },
+	{ MSR_LSTAR, "LSTAR" },
+	{ MSR_CSTAR, "CSTAR" },
+	{ MSR_SYSCALL_MASK, "SYSCALL_MASK" },
+	{ MSR_FS_BASE, "FS_BASE" },
+	{ MSR_GS_BASE, "GS_BASE" },
+	{ MSR_KERNEL_GS_BASE, "KERNEL_GS_BASE" },
+	{ MSR_TSC_AUX, "TSC_AUX" },
+	{ MSR_K7_HWCR, "HWCR" },
+	{ MSR_KVM_STEAL_TIME, "KVM_STEAL_TIME", MSR_RO },
+	{ MSR_KVM_POLL_CONTROL, "KVM_POLL_CONTROL" },
+};
+
+enum { CLASS_PASSTHROUGH, CLASS_KERNEL, CLASS_USERSPACE, NR_CLASSES };
+
+static const char *class_names[NR_CLASSES] = {
+	"passthrough", "kernel", "userspace",
+};
+
+static u64 kernel_ref, user_ref;
+static int nr_class[NR_CLASSES];
+static bool measured[ARRAY_SIZE(msrs)];
+
+/* The MSR of the current variant of "rdmsr" or "wrmsr" */
+static struct msr_cost *cur;
+static u64 cur_orig, cur_val;
+
+static int rdmsr_checking(u32 index, u64 *val)
+{
+	u32 a = 0, d = 0;
+
+	asm volatile (ASM_TRY("1f")
+		      "rdmsr\n\t"
+		      "1:"
+		      : "+a"(a), "+d"(d) : "c"(index) : "memory");
+	*val = a | ((u64)d << 32);
+	return exception_vector();
+}
+
+static int wrmsr_checking(u32 index, u64 val)
+{
+	asm volatile (ASM_TRY("1f")
+		      "wrmsr\n\t"
+		      "1:"
+		      : : "a"((u32)val), "d"((u32)(val >> 32)), "c"(index)
+		      : "memory");
+	return exception_vector();
+}
+
+static void exec_cpuid(void)
+{
+	raw_cpuid(0, 0);
+}
+
+static void exec_inl(void)
+{
+	inl(USERSPACE_PORT);
+}
+
+static void exec_rdmsr(void)
+{
+	rdmsr(cur->index);
+}
+
+static void exec_wrmsr(void)
+{
+	cur_val ^= cur->toggle;
+	wrmsr(cur->index, cur_val);
+}
+
+static bool can_read(struct msr_cost *m, u64 *val)
+{
+	return !(m->flags & MSR_WO) && rdmsr_checking(m->index, val) == 0;
+}
+
+static bool can_write(struct msr_cost *m, u64 *val)
+{
+	if (m->flags & MSR_RO)
+		return false;
+	if (m->flags & MSR_WO)
+		*val = m->wr_val;
+	else if (!can_read(m, val))
+		return false;
+
+	return wrmsr_checking(m->index, *val ^ m->toggle) == 0 &&
+	       wrmsr_checking(m->index, *val) == 0;
+}
+
+/*
+ * Select the next MSR that can be accessed.  The MSRs are only probed
+ * here, so that the SPEC_CTRL row sees KVM's state before IBRS is set.
+ */
+static bool msr_next(struct bench *b, bool write)
+{
+	int i = cur ? cur - msrs + 1 : 0;
+	u64 val = 0;
+
+	/* Leave the original value in the MSR */
+	if (write && cur)
+		wrmsr(cur->index, cur_orig);
+
+	for (; i < ARRAY_SIZE(msrs); i++)
+		if (write ? can_write(&msrs[i], &val) : can_read(&msrs[i], &val))
+			break;
+
+	if (i == ARRAY_SIZE(msrs)) {
+		cur = NULL;
+		return false;
+	}
+
+	cur = &msrs[i];
+	cur_orig = cur_val = val;
+	measured[i] = true;
+	b->variant = cur->name;
+	return true;
+}
+
+static bool rdmsr_next(struct bench *b)
+{
+	return msr_next(b, false);
+}
+
+static bool wrmsr_next(struct bench *b)
+{
+	return msr_next(b, true);
+}
+
+static u64 ticks_per_op(struct bench *b)
+{
+	return b->result.iterations ? b->result.ticks / b->result.iterations : 0;
+}
+
+static void classify(struct bench *b)
+{
+	u64 cycles = ticks_per_op(b);
+	int c;
+
+	if (cycles * 2 < kernel_ref)
+		c = CLASS_PASSTHROUGH;
+	else if (cycles * 2 < kernel_ref + user_ref)
+		c = CLASS_KERNEL;
+	else
+		c = CLASS_USERSPACE;
+
+	nr_class[c]++;
+	printf("  %#x %s\n", cur->index, class_names[c]);
+}
+
+static void set_kernel_ref(struct bench *b)
+{
+	kernel_ref = ticks_per_op(b);
+}
+
+static void set_user_ref(struct bench *b)
+{
+	user_ref = ticks_per_op(b);
+	if (user_ref <= kernel_ref)
+		printf("userspace PIO not slower than CPUID, classes are unreliable\n");
+}
+
+static struct bench refs[] = {
+	BENCH("cpuid", exec_cpuid, .report = set_kernel_ref),
+	BENCH("userspace_pio", exec_inl, .report = set_user_ref),
+};
+
+/* The references are needed to classify the accesses, run them first */
+static bool refs_prep(void)
+{
+	int i;
+
+	if (!kernel_ref)
+		for (i = 0; i < ARRAY_SIZE(refs); i++)
+			bench_run(&refs[i]);
+	return true;
+}
+
+static struct bench benches[] = {
+	BENCH("rdmsr", exec_rdmsr, .prep = refs_prep, .next = rdmsr_next,
+	      .report = classify),
+	BENCH("wrmsr", exec_wrmsr, .prep = refs_prep, .next = wrmsr_next,
+	      .report = classify),
+};
+
+int main(int ac, char **av)
+{
+	int i, nr = 0;
+
+	if (!this_cpu_has(X86_FEATURE_HYPERVISOR))
+		printf("not running under a hypervisor, all MSRs are native\n");
+
+	bench_run_all(benches, ARRAY_SIZE(benches), ac - 1, av + 1);
+
+	printf("accesses:");
+	for (i = 0; i < NR_CLASSES; i++)
+		printf(" %d %s", nr_class[i], class_names[i]);
+	printf("\n");
+
+	for (i = 0; i < ARRAY_SIZE(msrs); i++)
+		nr += measured[i];
+	report(nr, "%d of %d MSRs measured", nr, (int)ARRAY_SIZE(msrs));
+	return report_summary();
+}
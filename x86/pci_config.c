@@ -0,0 +1,172 @@
+/*
+ * PCI config space access benchmark
+ *
+ * Measures single config space reads and a full enumeration of the PCI
+ * hierarchy, like the one a guest does at boot, through the 0xCF8/0xCFC
+ * port pair and through MMCONFIG.  The enumeration reads the vendor and
+ * device ID of every function and the whole header of the functions
+ * that exist, and descends behind bridges.  Run it on q35 with many
+ * devices, for example pci-testdev or edu instances; without the MCFG
+ * table only the port pair is measured.
+ *
+ * Usage: pci_config.flat [benchmark globs...]
+ */
+#include "libcflat.h"
+#include "pci.h"
+#include "asm/pci.h"
+#include "bench.h"
+#include "clock.h"
+#include <linux/pci_regs.h>
+
+static const char *access_names[] = {
+	[PCI_CONFIG_CONF1] = "conf1",
+	[PCI_CONFIG_MMCFG] = "mmcfg",
+};
+
+#define PCI_HEADER_TYPE_MULTI_FUNC	0x80
+#define PCI_FN(devfn)			((devfn) & 7)
+
+static enum pci_config_access default_access;
+static int nr_devices, nr_reads;
+
+/* Cycle through the available access mechanisms */
+static bool access_next(struct bench *b)
+{
+	static int next;
+
+	while (next < ARRAY_SIZE(access_names)) {
+		if (pci_set_config_access(next)) {
+			b->variant = access_names[next++];
+			return true;
+		}
+		next++;
+	}
+
+	next = 0;
+	pci_set_config_access(default_access);
+	return false;
+}
+
+static bool mmcfg_next(struct bench *b)
+{
+	static bool done;
+
+	done = !done;
+	if (!done) {
+		pci_set_config_access(default_access);
+		return false;
+	}
+	b->variant = access_names[PCI_CONFIG_MMCFG];
+	return pci_set_config_access(PCI_CONFIG_MMCFG);
+}
+
+static bool has_mmcfg(void)
+{
+	return default_access == PCI_CONFIG_MMCFG;
+}
+
+static void read_id(void)
+{
+	pci_config_readl(0, PCI_VENDOR_ID);
+}
+
+/* The first dword of extended config space, i.e. the extended capability */
+static void read_ext(void)
+{
+	pci_config_readl(0, 0x100);
+}
+
+static void scan_bus(int bus)
+{
+	int devfn, reg;
+	pcidevaddr_t dev;
+	u8 header, secondary;
+
+	for (devfn = 0; devfn < PCI_DEVFN_MAX; devfn++) {
+		dev = (bus << 8) | devfn;
+		nr_reads++;
+		if (pci_config_readl(dev, PCI_VENDOR_ID) == 0xffffffff) {
+			/* No function 0, no other functions */
+			if (PCI_FN(devfn) == 0)
+				devfn += 7;
+			continue;
+		}
+
+		nr_devices++;
+		for (reg = 4; reg < 0x40; reg += 4)
+			pci_config_readl(dev, reg);
+		nr_reads += 0x40 / 4 - 1;
+
+		header = pci_config_readb(dev, PCI_HEADER_TYPE);
+		nr_reads++;
+		if (PCI_FN(devfn) == 0 && !(header & PCI_HEADER_TYPE_MULTI_FUNC))
+			devfn += 7;
+		if ((header & PCI_HEADER_TYPE_MASK) == PCI_HEADER_TYPE_BRIDGE) {
+			secondary = pci_config_readb(dev, PCI_SECONDARY_BUS);
+			nr_reads++;
+			/* Skip bridges that the firmware did not configure */
+			if (secondary > bus)
+				scan_bus(secondary);
+		}
+	}
+}
+
+static void enumerate(void)
+{
+	nr_devices = nr_reads = 0;
+	scan_bus(0);
+}
+
+static void print_reads_per_sec(u64 reads, struct bench_result *res)
+{
+	u64 ns = clock_ticks_to_ns(res->ticks);
+
+	printf("  %" PRIu64 " config reads/s\n",
+	       ns ? (u64)(reads * res->iterations * NSEC_PER_SEC / ns) : 0);
+}
+
+static void read_report(struct bench *b)
+{
+	print_reads_per_sec(1, &b->result);
+}
+
+static void enumerate_report(struct bench *b)
+{
+	printf("  %d functions, %d config reads per enumeration\n",
+	       nr_devices, nr_reads);
+	print_reads_per_sec(nr_reads, &b->result);
+}
+
+static struct bench tests[] = {
+	BENCH("read", read_id, .next = access_next, .report = read_report),
+	BENCH("read_ext", read_ext, .prep = has_mmcfg, .next = mmcfg_next,
+	      .report = read_report),
+	BENCH("enumerate", enumerate, .next = access_next,
+	      .report = enumerate_report),
+};
+
+int main(int ac, char **av)
+{
+	default_access = pci_get_config_access();
+	printf("default config access: %s\n", access_names[default_access]);
+
+	bench_run_all(tests, ARRAY_SIZE(tests), ac - 1, av + 1);
+
+	/* Both mechanisms reach the same standard config space */
+	if (has_mmcfg()) {
+		u32 conf1_id, mmcfg_id;
+
+		pci_set_config_access(PCI_CONFIG_CONF1);
+		conf1_id = pci_config_readl(0, PCI_VENDOR_ID);
+		pci_set_config_access(PCI_CONFIG_MMCFG);
+		mmcfg_id = pci_config_readl(0, PCI_VENDOR_ID);
+		pci_set_config_access(default_access);
+		report(conf1_id == mmcfg_id,
+		       "host bridge ID %#x through conf1, %#x through MMCONFIG",
+		       conf1_id, mmcfg_id);
+	}
+	report(pci_config_readl(0, PCI_VENDOR_ID) != 0xffffffff,
+	       "host bridge found through %s", access_names[default_access]);
+
+	return report_summary();
+}
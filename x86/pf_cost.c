@@ -0,0 +1,167 @@
+/*
+ * Page fault interception cost
+ *
+ * Times a load or a store to a page whose PTE is not present, read-only
+ * (with CR0.WP set) or has a reserved physical address bit set, caught
+ * by the exception table, against the same access without a fault.
+ *
+ * With TDP and the host's MAXPHYADDR, #PF goes straight to the guest and
+ * these are native costs.  KVM intercepts every #PF with shadow paging
+ * (kvm_intel.ept=0 or kvm_amd.npt=0), and, with a guest MAXPHYADDR
+ * smaller than the host's (kvm_intel.allow_smaller_maxphyaddr), those
+ * on present pages, so that it can inject reserved bit faults that the
+ * processor does not see.  Compare the four combinations to know what a
+ * guest pays after migrating to a host with more physical address bits.
+ *
+ * A delay in nanoseconds between two faults sets their rate, for
+ * example to see how much of the cost is in cold host caches.
+ *
+ * Usage: pf_cost.flat [delay [benchmark globs...]]
+ */
+#include "libcflat.h"
+#include "bench.h"
+#include "clock.h"
+#include "desc.h"
+#include "processor.h"
+#include "vm.h"
+#include "alloc_page.h"
+#include "vmalloc.h"
+
+#define PFERR_PRESENT_MASK	(1U << 0)
+#define PFERR_WRITE_MASK	(1U << 1)
+#define PFERR_RESERVED_MASK	(1U << 3)
+#define PFERR_MASK		(PFERR_PRESENT_MASK | PFERR_WRITE_MASK | \
+				 PFERR_RESERVED_MASK)
+
+static volatile u8 *page;
+static pteval_t *ptep, pte_base;
+static u64 delay_ticks;
+static int maxphyaddr;
+
+static void set_pte(pteval_t clear, pteval_t set)
+{
+	*ptep = (pte_base & ~clear) | set;
+	invlpg(page);
+}
+
+static void wait_delay(void)
+{
+	u64 end = rdtsc() + delay_ticks;
+
+	while (rdtsc() < end)
+		pause();
+}
+
+static u64 access_read(void)
+{
+	u64 t0;
+
+	wait_delay();
+	t0 = rdtsc();
+	asm volatile(ASM_TRY("1f")
+		     "movb (%0), %%al\n\t"
+		     "1:"
+		     : : "r"(page) : "rax", "memory");
+	return rdtsc() - t0;
+}
+
+static u64 access_write(void)
+{
+	u64 t0;
+
+	wait_delay();
+	t0 = rdtsc();
+	asm volatile(ASM_TRY("1f")
+		     "movb $0, (%0)\n\t"
+		     "1:"
+		     : : "r"(page) : "memory");
+	return rdtsc() - t0;
+}
+
+/* Do one access and check that it faults, or not, as expected */
+static bool check_access(const char *name, bool write, bool fault,
+			 unsigned int pferr)
+{
+	unsigned int vector, ec;
+
+	if (write)
+		access_write();
+	else
+		access_read();
+
+	vector = exception_vector();
+	ec = exception_error_code();
+	if (!fault) {
+		report(!vector, "%s: no exception", name);
+		return !vector;
+	}
+
+	report(vector == PF_VECTOR && (ec & PFERR_MASK) == pferr,
+	       "%s: #PF, error code %#x", name, ec);
+	return vector == PF_VECTOR;
+}
+
+static bool read_prep(void)
+{
+	set_pte(0, 0);
+	return check_access("read", false, false, 0);
+}
+
+static bool not_present_prep(void)
+{
+	set_pte(PT_PRESENT_MASK, 0);
+	return check_access("not_present", false, true, 0);
+}
+
+static bool protection_prep(void)
+{
+	set_pte(PT_WRITABLE_MASK, 0);
+	return check_access("protection", true, true,
+			    PFERR_PRESENT_MASK | PFERR_WRITE_MASK);
+}
+
+static bool reserved_prep(void)
+{
+	if (maxphyaddr >= 52)
+		return false;
+
+	set_pte(0, 1ull << maxphyaddr);
+	return check_access("reserved", false, true,
+			    PFERR_PRESENT_MASK | PFERR_RESERVED_MASK);
+}
+
+static struct bench benches[] = {
+	{ .name = "read", .measure = access_read, .prep = read_prep },
+	{ .name = "not_present", .measure = access_read,
+	  .prep = not_present_prep },
+	{ .name = "protection", .measure = access_write,
+	  .prep = protection_prep },
+	{ .name = "reserved", .measure = access_read, .prep = reserved_prep },
+};
+
+int main(int ac, char **av)
+{
+	u64 delay_ns = ac > 1 ? atol(av[1]) : 0;
+
+	setup_vm();
+	write_cr0(read_cr0() | X86_CR0_WP);
+
+	page = alloc_vpage();
+	install_page(phys_to_virt(read_cr3()), virt_to_phys(alloc_page()),
+		     (void *)page);
+	ptep = get_pte(phys_to_virt(read_cr3()), (void *)page);
+	pte_base = *ptep;
+
+	maxphyaddr = cpuid_maxphyaddr();
+	delay_ticks = delay_ns * get_clock_hz() / NSEC_PER_SEC;
+	printf("MAXPHYADDR %d, %" PRIu64 " ns between faults\n", maxphyaddr,
+	       delay_ns);
+	if (!this_cpu_has(X86_FEATURE_HYPERVISOR))
+		printf("not running under a hypervisor, all costs are native\n");
+
+	bench_run_all(benches, ARRAY_SIZE(benches), ac > 2 ? ac - 2 : 0,
+		      av + 2);
+
+	set_pte(0, 0);
+	return report_summary();
+}
@@ -8,6 +8,8 @@
 #include "alloc.h"
 
 #include "libcflat.h"
+#include "bench.h"
+#include "clock.h"
 #include <stdint.h>
 
 #define FIXED_CNT_INDEX 32
@@ -528,6 +530,215 @@ static void  check_gp_counters_write_width(void)
 	}
 }
 
+/*
+ * With "bench" on the command line, the test instead measures what PMU
+ * virtualization costs a guest that profiles: RDPMC, regular and fast,
+ * writes to an event select and to the global control, the latency from
+ * a counter overflow to the PMI, and how much loop() slows down with 0
+ * to N general purpose counters running.  Run it with the vPMU enabled
+ * and disabled (-cpu host,pmu=off); without a vPMU only loop() runs, as
+ * the baseline.  Further arguments select benchmarks, see bench_run_all().
+ */
+#define BENCH_EVNTSEL	(EVNTSEL_OS | EVNTSEL_USR | 0x00c0 /* instructions */)
+#define PMI_MAX_MISSES	10
+
+static pmu_counter_t *bench_cnt;
+static int nr_active = -1;
+static u64 loop_baseline, pmi_tsc, pmi_missed;
+
+static void bench_pmi(isr_regs_t *regs)
+{
+	pmi_tsc = rdtsc();
+	irq_received++;
+	apic_write(APIC_EOI, 0);
+}
+
+static bool has_counters(void)
+{
+	return num_counters > 0;
+}
+
+static bool has_global_ctrl(void)
+{
+	return num_counters > 0 && eax.split.version_id > 1;
+}
+
+static void counters_off(struct bench *b)
+{
+	wrmsr(MSR_P6_EVNTSEL0, 0);
+	wrmsr(MSR_CORE_PERF_GLOBAL_CTRL, 0);
+}
+
+static void bench_rdpmc(void)
+{
+	rdpmc(0);
+}
+
+static bool rdpmc_fast_prep(void)
+{
+	pmu_counter_t cnt = { .ctr = gp_counter_base };
+
+	return has_counters() &&
+	       !test_for_exception(GP_VECTOR, do_rdpmc_fast, &cnt);
+}
+
+static void bench_rdpmc_fast(void)
+{
+	rdpmc(1u << 31);
+}
+
+/* Start and stop counter 0, KVM reprograms its perf event each time */
+static bool evntsel_prep(void)
+{
+	if (!has_global_ctrl())
+		return false;
+	wrmsr(MSR_CORE_PERF_GLOBAL_CTRL, 1);
+	return true;
+}
+
+static void bench_evntsel(void)
+{
+	static bool on;
+
+	on = !on;
+	wrmsr(MSR_P6_EVNTSEL0, BENCH_EVNTSEL | (on ? EVNTSEL_EN : 0));
+}
+
+static bool global_ctrl_prep(void)
+{
+	if (!has_global_ctrl())
+		return false;
+	wrmsr(MSR_P6_EVNTSEL0, BENCH_EVNTSEL | EVNTSEL_EN);
+	return true;
+}
+
+static void bench_global_ctrl(void)
+{
+	static bool on;
+
+	on = !on;
+	wrmsr(MSR_CORE_PERF_GLOBAL_CTRL, on);
+}
+
+/*
+ * Counter 0 starts one instruction before overflowing; the time is
+ * taken from enabling the counter to the PMI handler.  Returns false if
+ * the PMI did not arrive.
+ */
+static bool pmi_latency_once(u64 *t)
+{
+	u64 t0, timeout;
+
+	wrmsr(MSR_P6_EVNTSEL0, 0);
+	wrmsr(MSR_CORE_PERF_GLOBAL_OVF_CTRL, rdmsr(MSR_CORE_PERF_GLOBAL_STATUS));
+	wrmsr(gp_counter_base, (1ull << eax.split.bit_width) - 1);
+	wrmsr(MSR_CORE_PERF_GLOBAL_CTRL, 1);
+	/* The LVT entry is masked when the PMI is delivered */
+	apic_write(APIC_LVTPC, PC_VECTOR);
+	irq_received = 0;
+
+	t0 = rdtsc();
+	timeout = t0 + get_clock_hz() / 10;
+	wrmsr(MSR_P6_EVNTSEL0, BENCH_EVNTSEL | EVNTSEL_EN | EVNTSEL_INT);
+	while (!irq_received && rdtsc() < timeout)
+		pause();
+	wrmsr(MSR_P6_EVNTSEL0, 0);
+
+	if (!irq_received)
+		return false;
+	*t = pmi_tsc - t0;
+	return true;
+}
+
+/* A missed PMI is not a sample, retry it */
+static u64 bench_pmi_latency(void)
+{
+	int misses = 0;
+	u64 t;
+
+	while (!pmi_latency_once(&t)) {
+		pmi_missed++;
+		if (++misses == PMI_MAX_MISSES)
+			report_abort("no PMI after %d overflows in a row",
+				     misses);
+	}
+	return t;
+}
+
+static bool pmi_prep(void)
+{
+	if (!has_global_ctrl())
+		return false;
+	irq_enable();
+	return true;
+}
+
+static void pmi_report(struct bench *b)
+{
+	irq_disable();
+	counters_off(b);
+}
+
+static void bench_loop(void)
+{
+	loop();
+}
+
+/* 0, 1, ... counters running, each counting instructions */
+static bool loop_next(struct bench *b)
+{
+	int i;
+
+	for (i = 0; i < nr_active; i++)
+		stop_event(&bench_cnt[i]);
+
+	if (!bench_next_count(b, &nr_active,
+			      has_global_ctrl() ? num_counters : 0))
+		return false;
+
+	for (i = 0; i < nr_active; i++) {
+		bench_cnt[i] = (pmu_counter_t) {
+			.ctr = gp_counter_base + i,
+			.config = BENCH_EVNTSEL,
+		};
+		start_event(&bench_cnt[i]);
+	}
+	return true;
+}
+
+static void loop_report(struct bench *b)
+{
+	bench_report_baseline(b, &loop_baseline, !nr_active,
+			      "with no counters");
+}
+
+static struct bench benches[] = {
+	BENCH("rdpmc", bench_rdpmc, .prep = has_counters),
+	BENCH("rdpmc_fast", bench_rdpmc_fast, .prep = rdpmc_fast_prep),
+	BENCH("wrmsr_evntsel", bench_evntsel, .prep = evntsel_prep,
+	      .report = counters_off),
+	BENCH("wrmsr_global_ctrl", bench_global_ctrl, .prep = global_ctrl_prep,
+	      .report = counters_off),
+	{ .name = "pmi_latency", .measure = bench_pmi_latency,
+	  .prep = pmi_prep, .report = pmi_report, .flags = BENCH_SAMPLE },
+	BENCH("loop", bench_loop, .next = loop_next, .report = loop_report),
+};
+
+static int bench(int ac, char **av)
+{
+	handle_irq(PC_VECTOR, bench_pmi);
+	bench_cnt = calloc(MAX(num_counters, 1), sizeof(*bench_cnt));
+
+	printf("PMU version %d, %d GP counters%s\n", eax.split.version_id,
+	       num_counters, num_counters ? "" : ", only the baseline runs");
+
+	bench_run_all(benches, ARRAY_SIZE(benches), ac, av);
+
+	if (has_global_ctrl())
+		report(!pmi_missed, "PMI after every overflow");
+	return report_summary();
+}
+
 int main(int ac, char **av)
 {
 	struct cpuid id = cpuid(10);
@@ -539,6 +750,10 @@ int main(int ac, char **av)
 	eax.full = id.a;
 	ebx.full = id.b;
 	edx.full = id.d;
+	num_counters = eax.split.num_counters;
+
+	if (ac > 1 && !strcmp(av[1], "bench"))
+		return bench(ac - 2, av + 2);
 
 	if (!eax.split.version_id) {
 		printf("No pmu is detected!\n");
@@ -551,8 +766,6 @@ int main(int ac, char **av)
 	printf("Fixed counters:      %d\n", edx.split.num_counters_fixed);
 	printf("Fixed counter width: %d\n", edx.split.bit_width_fixed);
 
-	num_counters = eax.split.num_counters;
-
 	apic_write(APIC_LVTPC, PC_VECTOR);
 
 	check_counters();
@@ -0,0 +1,354 @@
+/*
+ * KVM paravirtual IPI and TLB flush benchmark
+ *
+ * The ipi benchmarks send a fixed interrupt from CPU 0 to the first N
+ * other CPUs, for N growing up to all of them, and wait until every
+ * target has run the handler.  "ipi_icr" writes the ICR once for each
+ * target, like a guest without PV IPIs; "ipi_pv" sends the whole
+ * destination bitmap with one KVM_HC_SEND_IPI hypercall, like Linux
+ * does when KVM advertises KVM_FEATURE_PV_SEND_IPI.  For both, the time
+ * spent sending is printed separately from the time to completion.
+ *
+ * The tlb_flush benchmarks do a TLB shootdown to all other CPUs and
+ * measure the time until the initiator knows that every target has
+ * flushed, sending IPIs with KVM_HC_SEND_IPI if available.
+ * "tlb_flush_ipi" sends an IPI to every target and waits for the
+ * acknowledgements even if the target is preempted; "tlb_flush_pv"
+ * uses KVM_FEATURE_PV_TLB_FLUSH: it sets KVM_VCPU_FLUSH_TLB in the steal
+ * time area of the targets that KVM reports as preempted, so that KVM
+ * flushes their TLB when they run again, and only waits for the others.
+ * Rounds where some targets were preempted are reported separately; to
+ * get some, run the vCPU threads on fewer host CPUs than there are vCPUs.
+ *
+ * The targets spin with interrupts enabled for the whole test, so that
+ * they can be preempted; for the cost of waking up halted targets see
+ * intr_latency and idle_latency.
+ *
+ * Usage: pv_ipi.flat [benchmark globs...]
+ */
+#include "libcflat.h"
+#include "apic.h"
+#include "atomic.h"
+#include "isr.h"
+#include "msr.h"
+#include "processor.h"
+#include "smp.h"
+#include "x86/kvm_para.h"
+#include "bench.h"
+#include "clock.h"
+
+#define IPI_VECTOR		0xd0
+#define FLUSH_VECTOR		0xd1
+#define PV_IPI_BITMAP_BITS	128
+
+static int nr_targets, nr_dest;
+static bool has_pv_ipi, has_pv_tlb_flush;
+static atomic_t acks, targets_ready;
+static volatile bool targets_stop;
+static bool timed_out, pv_ipi_failed;
+static u64 send_ticks, nr_sends;
+
+enum { ROUND_RUNNING, ROUND_PREEMPTED, NR_ROUND_TYPES };
+
+struct tlb_stats {
+	u64 rounds, ticks, max;
+};
+
+static struct tlb_stats tlb_stats[NR_ROUND_TYPES];
+static u64 total_deferred, total_preempted;
+
+static void ipi_handler(isr_regs_t *regs)
+{
+	atomic_inc(&acks);
+	eoi();
+}
+
+static void flush_handler(isr_regs_t *regs)
+{
+	write_cr3(read_cr3());
+	atomic_inc(&acks);
+	eoi();
+}
+
+static void target_loop(void *data)
+{
+	steal_time_enable();
+	irq_enable();
+	atomic_inc(&targets_ready);
+
+	while (!targets_stop)
+		barrier();
+
+	irq_disable();
+	steal_time_disable();
+	atomic_dec(&targets_ready);
+}
+
+static void send_ipi_icr(int *cpus, int nr, int vector)
+{
+	int i;
+
+	for (i = 0; i < nr; i++)
+		apic_icr_write(APIC_INT_ASSERT | APIC_DEST_PHYSICAL |
+			       APIC_DM_FIXED | vector, id_map[cpus[i]]);
+}
+
+static void pv_send_bitmap(u64 *bitmap, u32 min, int vector)
+{
+	long ret;
+
+	ret = kvm_hypercall(KVM_HC_SEND_IPI, bitmap[0], bitmap[1], min,
+			    APIC_DM_FIXED | vector);
+	if (ret < 0)
+		pv_ipi_failed = true;
+	bitmap[0] = bitmap[1] = 0;
+}
+
+/*
+ * Each hypercall covers 128 APIC IDs starting at min; like Linux, start
+ * a new hypercall whenever a destination does not fit.
+ */
+static void send_ipi_pv(int *cpus, int nr, int vector)
+{
+	u64 bitmap[2] = {};
+	u32 min = 0, id;
+	bool empty = true;
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		id = id_map[cpus[i]];
+		if (!empty && (id < min || id >= min + PV_IPI_BITMAP_BITS)) {
+			pv_send_bitmap(bitmap, min, vector);
+			empty = true;
+		}
+		if (empty) {
+			min = id;
+			empty = false;
+		}
+		bitmap[(id - min) / 64] |= 1ull << ((id - min) % 64);
+	}
+	if (!empty)
+		pv_send_bitmap(bitmap, min, vector);
+}
+
+static void wait_acks(int nr)
+{
+	u64 timeout = rdtsc() + get_clock_hz();
+
+	while (atomic_read(&acks) < nr) {
+		if (rdtsc() > timeout) {
+			timed_out = true;
+			break;
+		}
+		pause();
+	}
+}
+
+static void multicast(bool pv)
+{
+	int cpus[MAX_TEST_CPUS], i;
+	u64 t0;
+
+	for (i = 0; i < nr_dest; i++)
+		cpus[i] = i + 1;
+
+	atomic_set(&acks, 0);
+	t0 = rdtsc();
+	if (pv)
+		send_ipi_pv(cpus, nr_dest, IPI_VECTOR);
+	else
+		send_ipi_icr(cpus, nr_dest, IPI_VECTOR);
+	send_ticks += rdtsc() - t0;
+	nr_sends++;
+
+	wait_acks(nr_dest);
+}
+
+static void ipi_icr(void)
+{
+	multicast(false);
+}
+
+static void ipi_pv(void)
+{
+	multicast(true);
+}
+
+static bool pv_ipi_prep(void)
+{
+	return has_pv_ipi;
+}
+
+/* 1, 2, 4, ... destinations, and all of them */
+static bool dest_next(struct bench *b)
+{
+	static char variant[16];
+
+	if (nr_dest >= nr_targets) {
+		nr_dest = 0;
+		return false;
+	}
+
+	nr_dest = nr_dest ? MIN(nr_dest * 2, nr_targets) : 1;
+	snprintf(variant, sizeof(variant), "%d", nr_dest);
+	b->variant = variant;
+	return true;
+}
+
+static void ipi_report(struct bench *b)
+{
+	struct bench_result res = {
+		.iterations = nr_sends,
+		.ticks = send_ticks,
+	};
+
+	bench_print("  send", &res);
+	send_ticks = nr_sends = 0;
+}
+
+static u64 tlb_flush(bool pv)
+{
+	int cpus[MAX_TEST_CPUS], nr = 0, cpu, preempted = 0;
+	struct tlb_stats *s;
+	u64 t0, t;
+
+	atomic_set(&acks, 0);
+	t0 = rdtsc();
+
+	for (cpu = 1; cpu <= nr_targets; cpu++) {
+		if (pv && steal_time_defer_flush(cpu)) {
+			total_deferred++;
+			preempted++;
+			continue;
+		}
+		if (steal_time_preempted(cpu))
+			preempted++;
+		cpus[nr++] = cpu;
+	}
+
+	/* The initiator flushes its own TLB while the targets do theirs */
+	if (has_pv_ipi)
+		send_ipi_pv(cpus, nr, FLUSH_VECTOR);
+	else
+		send_ipi_icr(cpus, nr, FLUSH_VECTOR);
+	write_cr3(read_cr3());
+	wait_acks(nr);
+
+	t = rdtsc() - t0;
+	total_preempted += preempted;
+	s = &tlb_stats[preempted ? ROUND_PREEMPTED : ROUND_RUNNING];
+	s->rounds++;
+	s->ticks += t;
+	s->max = MAX(s->max, t);
+	return t;
+}
+
+static u64 tlb_flush_ipi(void)
+{
+	return tlb_flush(false);
+}
+
+static u64 tlb_flush_pv(void)
+{
+	return tlb_flush(true);
+}
+
+static bool pv_tlb_flush_prep(void)
+{
+	return has_pv_tlb_flush;
+}
+
+static void tlb_flush_report(struct bench *b)
+{
+	static const char *types[NR_ROUND_TYPES] = {
+		[ROUND_RUNNING] = "all running",
+		[ROUND_PREEMPTED] = "some preempted",
+	};
+	struct tlb_stats *s;
+	u64 rounds = 0;
+	int i;
+
+	for (i = 0; i < NR_ROUND_TYPES; i++) {
+		s = &tlb_stats[i];
+		rounds += s->rounds;
+		if (!s->rounds)
+			continue;
+		printf("  %-14s %8" PRIu64 " rounds, avg %" PRIu64 " max %"
+		       PRIu64 " ns\n", types[i], s->rounds,
+		       clock_ticks_to_ns(s->ticks) / s->rounds,
+		       clock_ticks_to_ns(s->max));
+	}
+	printf("  %" PRIu64 " preempted targets, %" PRIu64 " flushes deferred"
+	       " to KVM in %" PRIu64 " rounds\n", total_preempted,
+	       total_deferred, rounds);
+
+	memset(tlb_stats, 0, sizeof(tlb_stats));
+	total_preempted = 0;
+}
+
+static struct bench tests[] = {
+	BENCH("ipi_icr", ipi_icr, .next = dest_next, .report = ipi_report),
+	BENCH("ipi_pv", ipi_pv, .prep = pv_ipi_prep, .next = dest_next,
+	      .report = ipi_report),
+	{ .name = "tlb_flush_ipi", .measure = tlb_flush_ipi,
+	  .report = tlb_flush_report },
+	{ .name = "tlb_flush_pv", .measure = tlb_flush_pv,
+	  .prep = pv_tlb_flush_prep, .report = tlb_flush_report },
+};
+
+int main(int ac, char **av)
+{
+	bool has_steal = kvm_has_feature(KVM_FEATURE_STEAL_TIME);
+	int cpu;
+
+	nr_targets = cpu_count() - 1;
+	if (!nr_targets) {
+		report_skip("pv_ipi needs at least two CPUs");
+		return report_summary();
+	}
+
+	has_pv_ipi = kvm_has_feature(KVM_FEATURE_PV_SEND_IPI);
+	has_pv_tlb_flush = has_steal &&
+			   kvm_has_feature(KVM_FEATURE_PV_TLB_FLUSH);
+	printf("%d targets, %s mode, PV IPI %s, PV TLB flush %s\n", nr_targets,
+	       rdmsr(MSR_IA32_APICBASE) & APIC_EXTD ? "x2APIC" : "xAPIC",
+	       has_pv_ipi ? "yes" : "no", has_pv_tlb_flush ? "yes" : "no");
+	if (!has_steal)
+		printf("no steal time, cannot detect preempted targets\n");
+
+	mask_pic_interrupts();
+	handle_irq(IPI_VECTOR, ipi_handler);
+	handle_irq(FLUSH_VECTOR, flush_handler);
+
+	for (cpu = 1; cpu <= nr_targets; cpu++)
+		on_cpu_async(cpu, target_loop, NULL);
+	while (atomic_read(&targets_ready) < nr_targets)
+		pause();
+
+	bench_run_all(tests, ARRAY_SIZE(tests), ac - 1, av + 1);
+
+	targets_stop = true;
+	while (atomic_read(&targets_ready))
+		pause();
+
+	report(!timed_out, "all IPIs acknowledged");
+	if (has_pv_ipi)
+		report(!pv_ipi_failed, "KVM_HC_SEND_IPI");
+	else
+		report_skip("KVM_HC_SEND_IPI not supported");
+
+	if (!has_pv_tlb_flush) {
+		report_skip("PV TLB flush not supported");
+	} else if (!total_deferred) {
+		report_skip("no TLB flush deferred, no target was preempted");
+	} else {
+		/* KVM clears the flags as soon as the vCPU runs again */
+		for (cpu = 1; cpu <= nr_targets; cpu++)
+			if (steal_time_flush_pending(cpu))
+				break;
+		report(cpu > nr_targets, "KVM did %" PRIu64
+		       " deferred TLB flushes", total_deferred);
+	}
+
+	return report_summary();
+}
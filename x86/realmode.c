@@ -1712,6 +1712,191 @@ static void test_perf_memory_rmw(void)
 	print_serial(" cycles/emulated memory RMW instruction\n");
 }
 
+/*
+ * Timed mode, selected with "-append bench": loops over instruction mixes
+ * that are common in bootloaders and option ROMs, and prints how many
+ * instructions per second the CPU, or KVM's emulator when unrestricted
+ * guest is unavailable or disabled, gets through.  "rep movsb" counts as
+ * one instruction.
+ */
+#define BENCH_COUNT 100000
+
+#define PIT_HZ 1193182
+#define PIT_MS 50
+
+#define MB_INFO_CMDLINE 4
+
+/* Physical address of the multiboot info, saved by the entry code */
+u32 mb_info;
+
+static u16 bench_farptr[2];
+static u8 bench_buf[2][64];
+
+#define MK_INSN_BENCH(name, insn)			\
+	MK_INSN(name, "1:" insn "\n"			\
+		      "dec %ebp; jnz 1b")
+
+asm ("bench_ljmp: ljmpw $0, $retf");
+
+MK_INSN_BENCH(bench_loop, "");
+MK_INSN_BENCH(bench_string, "mov %bx, %si; mov %dx, %di; mov $16, %cx\n"
+			    "rep movsb; stosw; lodsb");
+MK_INSN_BENCH(bench_far, "lcallw $0, $bench_ljmp");
+MK_INSN_BENCH(bench_segment, "mov %ax, %ds; mov %ax, %es; mov %ax, %fs\n"
+			     "lds (%si), %dx; les (%si), %dx");
+MK_INSN_BENCH(bench_int, "int $0x11");
+
+static struct {
+	const char *name;
+	struct insn_desc *insn;
+	u32 insns;	/* per iteration, including dec and jnz */
+} bench_mixes[] = {
+	{ "loop", &insn_bench_loop, 2 },
+	{ "string ops", &insn_bench_string, 8 },
+	{ "far jmp/call/ret", &insn_bench_far, 5 },
+	{ "segment loads", &insn_bench_segment, 7 },
+	{ "int/iret", &insn_bench_int, 4 },
+};
+
+/* Read guest physical memory below 1 MiB, which can be outside DS */
+static u8 peekb(u32 addr)
+{
+	u8 val;
+
+	asm volatile("pushw %%fs \n\t"
+		     "mov %w1, %%fs \n\t"
+		     "movb %%fs:(%2), %0 \n\t"
+		     "popw %%fs"
+		     : "=q"(val) : "r"(addr >> 4), "r"(addr & 15));
+	return val;
+}
+
+static u32 peekl(u32 addr)
+{
+	return peekb(addr) | peekb(addr + 1) << 8 |
+	       peekb(addr + 2) << 16 | (u32)peekb(addr + 3) << 24;
+}
+
+static _Bool cmdline_has(const char *word)
+{
+	u32 p;
+	int i;
+
+	if (!(peekl(mb_info) & MB_INFO_CMDLINE))
+		return 0;
+
+	p = peekl(mb_info + 16);
+	for (;;) {
+		while (peekb(p) == ' ')
+			p++;
+		if (!peekb(p))
+			return 0;
+		for (i = 0; word[i] && peekb(p + i) == word[i]; i++)
+			;
+		if (!word[i] && (!peekb(p + i) || peekb(p + i) == ' '))
+			return 1;
+		while (peekb(p) && peekb(p) != ' ')
+			p++;
+	}
+}
+
+static u64 rdtsc(void)
+{
+	u64 val;
+
+	asm volatile("rdtsc" : "=A"(val));
+	return val;
+}
+
+/*
+ * There is no libgcc, so divide with divl, in two steps like do_div() so
+ * that the quotient cannot overflow.
+ */
+static u64 div64_32(u64 n, u32 d)
+{
+	u32 hi = n >> 32, lo = n, r;
+
+	r = hi % d;
+	hi /= d;
+	asm("divl %2" : "+a"(lo), "+d"(r) : "rm"(d));
+	return (u64)hi << 32 | lo;
+}
+
+/* Count TSC ticks during a one-shot countdown of PIT channel 2 */
+static u32 tsc_khz(void)
+{
+	u32 latch = PIT_HZ / (1000 / PIT_MS);
+	u8 port61 = inb(0x61);
+	u64 start, end;
+
+	/* Gate channel 2 on with the speaker off, mode 0, binary count */
+	outb((port61 & ~0x02) | 0x01, 0x61);
+	outb(0xb0, 0x43);
+	outb(latch & 0xff, 0x42);
+	outb(latch >> 8, 0x42);
+
+	start = rdtsc();
+	while (!(inb(0x61) & 0x20))
+		;
+	end = rdtsc();
+
+	outb(port61, 0x61);
+	return (u32)(end - start) / PIT_MS;
+}
+
+static void test_bench(void)
+{
+	u32 khz = tsc_khz();
+	u32 insns, c100;
+	u64 start, cycles, us;
+	int i;
+
+	print_serial("TSC frequency ");
+	print_serial_u32(khz);
+	print_serial(" kHz, ");
+	print_serial_u32(BENCH_COUNT);
+	print_serial(" iterations per mix\n");
+
+	*(u32 *)(0x11 * 4) = 0x1000;
+	*(u8 *)(0x1000) = 0xcf; /* iret */
+
+	for (i = 0; i < ARRAY_SIZE(bench_mixes); i++) {
+		init_inregs(&(struct regs){
+			.ebx = (u32)bench_buf[0],
+			.edx = (u32)bench_buf[1],
+			.esi = (u32)bench_farptr,
+			.ebp = BENCH_COUNT,
+		});
+
+		start = rdtsc();
+		exec_in_big_real_mode(bench_mixes[i].insn);
+		cycles = rdtsc() - start;
+
+		report(bench_mixes[i].name, ~R_SP, outregs.ebp == 0);
+
+		/*
+		 * Fast mixes run billions of instructions per second, so the
+		 * rate is in thousands, and the cost per instruction in
+		 * hundredths of a cycle.
+		 */
+		insns = BENCH_COUNT * bench_mixes[i].insns;
+		c100 = div64_32(cycles * 100, insns);
+		print_serial(bench_mixes[i].name);
+		print_serial(": ");
+		us = khz ? div64_32(cycles * 1000, khz) : 0;
+		if (us) {
+			print_serial_u32(div64_32((u64)insns * 1000, us));
+			print_serial(" kinstructions/s, ");
+		}
+		print_serial_u32(div64_32(cycles, BENCH_COUNT));
+		print_serial(" cycles/iteration, ");
+		print_serial_u32(c100 / 100);
+		print_serial(c100 % 100 < 10 ? ".0" : ".");
+		print_serial_u32(c100 % 100);
+		print_serial(" cycles/instruction\n");
+	}
+}
+
 static void test_dr_mod(void)
 {
 	MK_INSN(drmod, "movl %ebx, %dr0\n\t"
@@ -1751,6 +1936,11 @@ static void test_xadd(void)
 
 void realmode_start(void)
 {
+	if (cmdline_has("bench")) {
+		test_bench();
+		exit(failed);
+	}
+
 	test_null();
 
 	test_shld();
@@ -1832,6 +2022,7 @@ asm(
 
 	".text \n\t"
 	"start: \n\t"
+	"mov %ebx, mb_info \n\t"
 	"lgdt r_gdt_descr \n\t"
 	"lidt r_idt_descr \n\t"
 	"ljmp $8, $1f; 1: \n\t"
@@ -1,5 +1,6 @@
 #include "libcflat.h"
 #include "x86/acpi.h"
+#include "x86/rtc.h"
 #include "asm/io.h"
 
 static u32* find_resume_vector_addr(void)
@@ -11,30 +12,6 @@ static u32* find_resume_vector_addr(void)
     return &facs->firmware_waking_vector;
 }
 
-#define RTC_SECONDS_ALARM       1
-#define RTC_MINUTES_ALARM       3
-#define RTC_HOURS_ALARM         5
-#define RTC_ALARM_DONT_CARE     0xC0
-
-#define RTC_REG_A               10
-#define RTC_REG_B               11
-#define RTC_REG_C               12
-
-#define REG_A_UIP               0x80
-#define REG_B_AIE               0x20
-
-static inline int rtc_in(u8 reg)
-{
-    outb(reg, 0x70);
-    return inb(0x71);
-}
-
-static inline void rtc_out(u8 reg, u8 val)
-{
-    outb(reg, 0x70);
-    outb(val, 0x71);
-}
-
 extern char resume_start, resume_end;
 
 int main(int argc, char **argv)
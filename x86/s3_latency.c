@@ -0,0 +1,328 @@
+/*
+ * S3 suspend/resume round-trip latency
+ *
+ * Like the s3 test, this arms the RTC alarm and enters S3 through the
+ * PM1a control register, but instead of exiting from the resume vector
+ * it goes back to long mode with the page tables, GDT, IDT and TSS from
+ * before the suspend and continues the test, so that it can do several
+ * suspend/resume cycles.  Every phase is timestamped with the ACPI PM
+ * timer, which keeps counting across the reset of the vCPUs:
+ *
+ *   sleep:   from the write to PM1a_CNT until the RTC alarm, which fires
+ *            at the first second boundary after the alarm is armed
+ *   wake:    from the RTC alarm until the first instruction of the resume
+ *            vector, i.e. QEMU, KVM and the firmware
+ *   restore: from the resume vector until the test runs again in C
+ *
+ * The wake source is read back from the PM1a status register.  The
+ * cost of the reset depends on the number of vCPUs and possibly on the
+ * memory size; compare runs with different -smp and -m.  After the first
+ * cycle the APs stay in wait-for-SIPI.
+ *
+ * Usage: s3_latency.flat [cycles]
+ */
+#include "libcflat.h"
+#include "x86/acpi.h"
+#include "x86/apic.h"
+#include "x86/desc.h"
+#include "x86/fwcfg.h"
+#include "x86/msr.h"
+#include "x86/processor.h"
+#include "x86/rtc.h"
+#include "x86/smp.h"
+#include "asm/io.h"
+#include "setjmp.h"
+
+#define DEFAULT_CYCLES		5
+#define S3_RESUME_ADDR		0x1000
+
+#define PM1_RTC_STS		(1 << 10)
+#define PM1_WAK_STS		(1 << 15)
+#define PM1_RTC_EN		(1 << 10)
+#define PM1_SLP_TYP_S3		(1 << 10)
+#define PM1_SLP_EN		(1 << 13)
+
+enum { PHASE_SLEEP, PHASE_WAKE, PHASE_RESTORE, PHASE_TOTAL, NR_PHASES };
+
+static const char *phase_names[NR_PHASES] = {
+	"sleep", "wake", "restore", "total",
+};
+
+struct phase_stats {
+	u64 count, min, max, total;
+};
+
+static struct phase_stats stats[NR_PHASES];
+
+/* Used by the resume path, before it can run C code */
+u64 s3_saved_cr0, s3_saved_cr3, s3_saved_cr4, s3_saved_efer;
+u64 s3_saved_gs_base;
+ulong s3_resume_rsp;
+
+static struct descriptor_table_ptr saved_gdt, saved_idt;
+static u16 saved_tr;
+static bool saved_x2apic;
+static jmp_buf resume_jmpbuf;
+static u8 resume_stack[4096] __attribute__((aligned(16)));
+
+static struct fadt_descriptor_rev1 *fadt;
+
+extern char s3_resume_start, s3_resume_end, s3_resume_port, s3_resume_pm_tmr;
+void s3_resume(void);
+
+static u32 pm_tmr(void)
+{
+	return inl(fadt->pm_tmr_blk) & PM_TIMER_MASK;
+}
+
+/* PM timer ticks from a to b, the timer wraps every 4.7 seconds */
+static s64 pm_tmr_delta(u32 a, u32 b)
+{
+	u32 d = (b - a) & PM_TIMER_MASK;
+
+	/* Sign-extend from 24 bits */
+	return (s32)(d << 8) >> 8;
+}
+
+static s64 pm_tmr_to_us(s64 ticks)
+{
+	return ticks * 1000000 / PM_TIMER_HZ;
+}
+
+static void *resume_stub(char *sym)
+{
+	return (void *)S3_RESUME_ADDR + (sym - &s3_resume_start);
+}
+
+/*
+ * Called by the resume path in long mode, with the saved control
+ * registers, segments and GS base, on resume_stack.
+ */
+void s3_resume(void)
+{
+	gdt_entry_t *tss = (void *)saved_gdt.base + saved_tr;
+
+	lidt(&saved_idt);
+
+	/* The TSS descriptor is still marked busy from before the reset */
+	tss->access &= ~0x02;
+	ltr(saved_tr);
+
+	reset_apic();
+	mask_pic_interrupts();
+	enable_apic();
+	if (saved_x2apic)
+		enable_x2apic();
+
+	longjmp(resume_jmpbuf, 1);
+}
+
+static void save_state(void)
+{
+	s3_saved_cr0 = read_cr0();
+	s3_saved_cr3 = read_cr3();
+	s3_saved_cr4 = read_cr4();
+	s3_saved_efer = rdmsr(MSR_EFER);
+	s3_saved_gs_base = rdmsr(MSR_GS_BASE);
+	s3_resume_rsp = (ulong)resume_stack + sizeof(resume_stack);
+	sgdt(&saved_gdt);
+	sidt(&saved_idt);
+	saved_tr = str();
+	saved_x2apic = rdmsr(MSR_IA32_APICBASE) & APIC_EXTD;
+}
+
+/* Returns the PM timer at the second boundary that was just crossed */
+static u32 arm_rtc_alarm(void)
+{
+	u32 edge;
+
+	while ((rtc_in(RTC_REG_A) & REG_A_UIP) == 0);
+	while ((rtc_in(RTC_REG_A) & REG_A_UIP) != 0);
+	edge = pm_tmr();
+
+	rtc_in(RTC_REG_C);
+	rtc_out(RTC_SECONDS_ALARM, RTC_ALARM_DONT_CARE);
+	rtc_out(RTC_MINUTES_ALARM, RTC_ALARM_DONT_CARE);
+	rtc_out(RTC_HOURS_ALARM, RTC_ALARM_DONT_CARE);
+	rtc_out(RTC_REG_B, rtc_in(RTC_REG_B) | REG_B_AIE);
+	return edge;
+}
+
+static void account(int phase, s64 us)
+{
+	struct phase_stats *s = &stats[phase];
+
+	us = MAX(us, 0);
+	if (!s->count++ || us < s->min)
+		s->min = us;
+	s->max = MAX(s->max, us);
+	s->total += us;
+}
+
+static bool cycle(int n)
+{
+	volatile u32 *resume_pm_tmr = resume_stub(&s3_resume_pm_tmr);
+	/* Set after setjmp() and used after longjmp() */
+	volatile u32 t_pm1;
+	u32 edge, t_wake, t_vec, t_back;
+	s64 us[NR_PHASES];
+	u16 status;
+	int i;
+
+	outw(PM1_WAK_STS | PM1_RTC_STS, fadt->pm1a_evt_blk);
+	outw(PM1_RTC_EN, fadt->pm1a_evt_blk + 2);
+	*resume_pm_tmr = 0;
+
+	edge = arm_rtc_alarm();
+	save_state();
+	if (setjmp(resume_jmpbuf) == 0) {
+		t_pm1 = pm_tmr();
+		outw(PM1_SLP_EN | PM1_SLP_TYP_S3, fadt->pm1a_cnt_blk);
+
+		/* The alarm fires within a second */
+		while (pm_tmr_delta(t_pm1, pm_tmr()) < 2 * PM_TIMER_HZ)
+			pause();
+		printf("cycle %d: S3 not entered\n", n);
+		return false;
+	}
+
+	t_back = pm_tmr();
+	t_vec = *resume_pm_tmr & PM_TIMER_MASK;
+	t_wake = (edge + PM_TIMER_HZ) & PM_TIMER_MASK;
+	status = inw(fadt->pm1a_evt_blk);
+
+	rtc_out(RTC_REG_B, rtc_in(RTC_REG_B) & ~REG_B_AIE);
+	rtc_in(RTC_REG_C);
+
+	us[PHASE_SLEEP] = pm_tmr_to_us(pm_tmr_delta(t_pm1, t_wake));
+	us[PHASE_WAKE] = pm_tmr_to_us(pm_tmr_delta(t_wake, t_vec));
+	us[PHASE_RESTORE] = pm_tmr_to_us(pm_tmr_delta(t_vec, t_back));
+	us[PHASE_TOTAL] = pm_tmr_to_us(pm_tmr_delta(t_pm1, t_back));
+
+	printf("cycle %d: wake source %s,", n,
+	       (status & PM1_WAK_STS) && (status & PM1_RTC_STS) ? "RTC" :
+								   "unknown");
+	for (i = 0; i < NR_PHASES; i++) {
+		printf(" %s %" PRId64 " us", phase_names[i], us[i]);
+		account(i, us[i]);
+	}
+	printf("\n");
+	return true;
+}
+
+int main(int ac, char **av)
+{
+	int cycles = ac > 1 ? atol(av[1]) : DEFAULT_CYCLES;
+	struct facs_descriptor_rev1 *facs;
+	char *addr, *resume_vec = (void *)S3_RESUME_ADDR;
+	int n, ok = 0, i;
+
+	fadt = find_acpi_table_addr(FACP_SIGNATURE);
+	facs = find_acpi_table_addr(FACS_SIGNATURE);
+	if (!fadt || !facs || !fadt->pm_tmr_blk) {
+		report_skip("no FADT, FACS or PM timer");
+		return report_summary();
+	}
+
+	printf("%d CPUs, %" PRIu64 " MiB, %d cycles\n", cpu_count(),
+	       fwcfg_get_u64(FW_CFG_RAM_SIZE) >> 20, cycles);
+
+	for (addr = &s3_resume_start; addr < &s3_resume_end; addr++)
+		*resume_vec++ = *addr;
+	*(u16 *)resume_stub(&s3_resume_port) = fadt->pm_tmr_blk;
+	facs->firmware_waking_vector = S3_RESUME_ADDR;
+
+	irq_disable();
+	for (n = 0; n < cycles; n++) {
+		if (!cycle(n))
+			break;
+		ok++;
+	}
+
+	if (ok) {
+		printf("%-8s %10s %10s %10s\n", "phase", "min us", "avg us",
+		       "max us");
+		for (i = 0; i < NR_PHASES; i++)
+			printf("%-8s %10" PRIu64 " %10" PRIu64 " %10" PRIu64 "\n",
+			       phase_names[i], stats[i].min,
+			       stats[i].total / ok, stats[i].max);
+	}
+
+	report(ok == cycles, "%d of %d suspend/resume cycles", ok, cycles);
+	return report_summary();
+}
+
+/*
+ * The firmware jumps to the resume vector in real mode, with CS pointing
+ * to it.  The stub reads the PM timer and switches to a flat 32-bit code
+ * segment, then s3_resume32 enables long mode like the startup code does.
+ */
+asm (
+	".code16\n"
+	"s3_resume_start:\n"
+	"	mov %cs, %ax\n"
+	"	mov %ax, %ds\n"
+	"	mov s3_resume_port - s3_resume_start, %dx\n"
+	"	inl %dx, %eax\n"
+	"	mov %eax, s3_resume_pm_tmr - s3_resume_start\n"
+	"	lgdtl s3_resume_gdt_desc - s3_resume_start\n"
+	"	mov %cr0, %eax\n"
+	"	or $1, %eax\n"
+	"	mov %eax, %cr0\n"
+	"	ljmpl $8, $s3_resume32\n"
+	".align 8\n"
+	"s3_resume_gdt:\n"
+	"	.quad 0\n"
+	"	.quad 0x00cf9b000000ffff\n"
+	"	.quad 0x00cf93000000ffff\n"
+	"s3_resume_gdt_desc:\n"
+	"	.word 3 * 8 - 1\n"
+	"	.long " xstr(S3_RESUME_ADDR) " + s3_resume_gdt - s3_resume_start\n"
+	"s3_resume_port:\n"
+	"	.word 0\n"
+	"s3_resume_pm_tmr:\n"
+	"	.long 0\n"
+	"s3_resume_end:\n"
+
+	".code32\n"
+	"s3_resume32:\n"
+	"	mov $0x10, %ax\n"
+	"	mov %ax, %ds\n"
+	"	mov %ax, %es\n"
+	"	mov %ax, %ss\n"
+	"	lgdt gdt64_desc\n"
+	/* CR4.PCIDE can only be set in long mode */
+	"	mov s3_saved_cr4, %eax\n"
+	"	btr $17, %eax\n"
+	"	mov %eax, %cr4\n"
+	"	mov s3_saved_cr3, %eax\n"
+	"	and $~0xfff, %eax\n"
+	"	mov %eax, %cr3\n"
+	"	mov $" xstr(MSR_EFER) ", %ecx\n"
+	"	mov s3_saved_efer, %eax\n"
+	"	btr $10, %eax\n"	/* EFER.LMA is read-only */
+	"	xor %edx, %edx\n"
+	"	wrmsr\n"
+	"	mov s3_saved_cr0, %eax\n"
+	"	mov %eax, %cr0\n"
+	"	ljmpl $8, $s3_resume64\n"
+
+	".code64\n"
+	"s3_resume64:\n"
+	"	mov $0x10, %ax\n"
+	"	mov %ax, %ds\n"
+	"	mov %ax, %es\n"
+	"	mov %ax, %fs\n"
+	"	mov %ax, %gs\n"
+	"	mov %ax, %ss\n"
+	"	mov $" xstr(MSR_GS_BASE) ", %ecx\n"
+	"	mov s3_saved_gs_base(%rip), %eax\n"
+	"	mov s3_saved_gs_base + 4(%rip), %edx\n"
+	"	wrmsr\n"
+	"	mov s3_saved_cr4(%rip), %rax\n"
+	"	mov %rax, %cr4\n"
+	"	mov s3_saved_cr3(%rip), %rax\n"
+	"	mov %rax, %cr3\n"
+	"	mov s3_resume_rsp(%rip), %rsp\n"
+	"	call s3_resume\n"
+);
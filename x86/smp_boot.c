@@ -0,0 +1,89 @@
+/*
+ * vCPU bring-up benchmark
+ *
+ * Reports the timestamps that the startup code records while bringing up
+ * the CPUs: the first instruction of the BSP, the INIT/SIPI broadcast in
+ * ap_init, the time each AP comes online and the time each AP runs its
+ * part of smp_init(), which goes through the APs one at a time with
+ * on_cpu().  From these, it prints how long it took for the first N APs
+ * to be online and ready, for N up to the number of CPUs of the guest.
+ *
+ * KVM starts the TSC from zero when the vCPU is created, so the time of
+ * the first instruction includes the firmware.  To see how the part of
+ * the boot in KVM scales, compare runs with -smp from 1 to the maximum
+ * supported by the host.
+ *
+ * Usage: smp_boot.flat [-v]
+ */
+#include "libcflat.h"
+#include "bench.h"
+#include "apic.h"
+#include "processor.h"
+#include "smp.h"
+#include "clock.h"
+
+static u64 online[MAX_TEST_CPUS], ready[MAX_TEST_CPUS];
+
+static u64 ticks_to_us(u64 ticks)
+{
+	return clock_ticks_to_ns(ticks) / 1000;
+}
+
+int main(int ac, char **av)
+{
+	u64 main_tsc = rdtsc();
+	bool verbose = ac > 1 && !strcmp(av[1], "-v");
+	int nr_aps = cpu_count() - 1, i, n;
+	bool ok = true;
+
+	printf("%d CPUs, TSC at %" PRIu64 " Hz\n", cpu_count(),
+	       (u64)get_clock_hz());
+	printf("first instruction:  %10" PRIu64 " us\n",
+	       ticks_to_us(boot_tsc_start));
+	printf("INIT/SIPI sent:     %10" PRIu64 " us\n",
+	       ticks_to_us(boot_tsc_ap_init));
+	printf("smp_init start:     %10" PRIu64 " us\n",
+	       ticks_to_us(boot_tsc_smp_init));
+	printf("smp_init end:       %10" PRIu64 " us\n",
+	       ticks_to_us(boot_tsc_smp_done));
+	printf("main:               %10" PRIu64 " us\n", ticks_to_us(main_tsc));
+
+	if (!nr_aps) {
+		report_skip("no APs");
+		return report_summary();
+	}
+
+	for (i = 0; i < nr_aps; i++) {
+		u8 id = id_map[i + 1];
+
+		ok &= boot_tsc_online[id] >= boot_tsc_ap_init &&
+		      boot_tsc_ready[id] >= boot_tsc_smp_init &&
+		      boot_tsc_ready[id] <= boot_tsc_smp_done;
+		online[i] = boot_tsc_online[id] - boot_tsc_ap_init;
+		ready[i] = boot_tsc_ready[id] - boot_tsc_smp_init;
+		if (verbose)
+			printf("cpu%d (APIC ID %d): online %" PRIu64
+			       " us after INIT, ready %" PRIu64
+			       " us after smp_init\n", i + 1, id,
+			       ticks_to_us(online[i]), ticks_to_us(ready[i]));
+	}
+	report(ok, "timestamps for %d APs", nr_aps);
+
+	/* Time until the first n APs were online, or ready */
+	bench_sort(online, nr_aps);
+	bench_sort(ready, nr_aps);
+	printf("%6s %12s %12s\n", "APs", "online us", "ready us");
+	for (n = 1; n < nr_aps; n *= 2)
+		printf("%6d %12" PRIu64 " %12" PRIu64 "\n", n,
+		       ticks_to_us(online[n - 1]), ticks_to_us(ready[n - 1]));
+	printf("%6d %12" PRIu64 " %12" PRIu64 "\n", nr_aps,
+	       ticks_to_us(online[nr_aps - 1]), ticks_to_us(ready[nr_aps - 1]));
+
+	printf("bring-up: %d APs online in %" PRIu64 " us, smp_init %" PRIu64
+	       " us (%" PRIu64 " ns per AP)\n", nr_aps,
+	       ticks_to_us(online[nr_aps - 1]),
+	       ticks_to_us(boot_tsc_smp_done - boot_tsc_smp_init),
+	       clock_ticks_to_ns(boot_tsc_smp_done - boot_tsc_smp_init) / nr_aps);
+
+	return report_summary();
+}
@@ -225,12 +225,12 @@ struct svm_test *v2_test;
 
 u64 guest_stack[10000];
 
-int svm_vmrun(void)
+/*
+ * Re-enter the guest where it exited, e.g. after handling a nested page
+ * fault; the guest must have been started with svm_vmrun().
+ */
+int svm_vmrun_resume(void)
 {
-	vmcb->save.rip = (ulong)test_thunk;
-	vmcb->save.rsp = (ulong)(guest_stack + ARRAY_SIZE(guest_stack));
-	regs.rdi = (ulong)v2_test;
-
 	asm volatile (
 		ASM_VMRUN_CMD
 		:
@@ -240,6 +240,15 @@ int svm_vmrun(void)
 	return (vmcb->control.exit_code);
 }
 
+int svm_vmrun(void)
+{
+	vmcb->save.rip = (ulong)test_thunk;
+	vmcb->save.rsp = (ulong)(guest_stack + ARRAY_SIZE(guest_stack));
+	regs.rdi = (ulong)v2_test;
+
+	return svm_vmrun_resume();
+}
+
 static void test_run(struct svm_test *test)
 {
 	u64 vmcb_phys = virt_to_phys(vmcb);
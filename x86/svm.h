@@ -391,6 +391,7 @@ void vmcb_ident(struct vmcb *vmcb);
 struct regs get_regs(void);
 void vmmcall(void);
 int svm_vmrun(void);
+int svm_vmrun_resume(void);
 void test_set_guest(test_guest_func func);
 
 extern struct vmcb *vmcb;
@@ -10,35 +10,16 @@
 #include "isr.h"
 #include "apic.h"
 #include "delay.h"
+#include "vmalloc.h"
+#include "clock.h"
+#include "bench.h"
 
 #define SVM_EXIT_MAX_DR_INTERCEPT 0x3f
 
 static void *scratch_page;
 
-#define LATENCY_RUNS 1000000
-
 extern u16 cpu_online_count;
 
-u64 tsc_start;
-u64 tsc_end;
-
-u64 vmrun_sum, vmexit_sum;
-u64 vmsave_sum, vmload_sum;
-u64 stgi_sum, clgi_sum;
-u64 latvmrun_max;
-u64 latvmrun_min;
-u64 latvmexit_max;
-u64 latvmexit_min;
-u64 latvmload_max;
-u64 latvmload_min;
-u64 latvmsave_max;
-u64 latvmsave_min;
-u64 latstgi_max;
-u64 latstgi_min;
-u64 latclgi_max;
-u64 latclgi_min;
-u64 runs;
-
 static void null_test(struct svm_test *test)
 {
 }
@@ -962,141 +943,94 @@ static bool tsc_adjust_check(struct svm_test *test)
     return ok && adjust <= -2 * TSC_ADJUST_VALUE;
 }
 
-static void latency_prepare(struct svm_test *test)
+static volatile u64 lat_guest_entry, lat_guest_exit;
+
+static void latency_guest(struct svm_test *test)
 {
-    default_prepare(test);
-    runs = LATENCY_RUNS;
-    latvmrun_min = latvmexit_min = -1ULL;
-    latvmrun_max = latvmexit_max = 0;
-    vmrun_sum = vmexit_sum = 0;
-    tsc_start = rdtsc();
+    for (;;) {
+        lat_guest_entry = rdtsc();
+        lat_guest_exit = rdtsc();
+        asm volatile ("vmmcall" : : : "memory");
+    }
 }
 
-static void latency_test(struct svm_test *test)
+static void latency_resume(void)
 {
-    u64 cycles;
-
-start:
-    tsc_end = rdtsc();
-
-    cycles = tsc_end - tsc_start;
-
-    if (cycles > latvmrun_max)
-        latvmrun_max = cycles;
-
-    if (cycles < latvmrun_min)
-        latvmrun_min = cycles;
-
-    vmrun_sum += cycles;
-
-    tsc_start = rdtsc();
+    int exit_code;
 
-    asm volatile ("vmmcall" : : : "memory");
-    goto start;
+    vmcb->save.rip += 3;
+    exit_code = svm_vmrun_resume();
+    assert_msg(exit_code == SVM_EXIT_VMMCALL,
+               "unexpected exit code %x", exit_code);
 }
 
-static bool latency_finished(struct svm_test *test)
+/* From VMRUN until the guest runs */
+static u64 latency_vmrun(void)
 {
-    u64 cycles;
-
-    tsc_end = rdtsc();
-
-    cycles = tsc_end - tsc_start;
+    u64 start = rdtsc();
 
-    if (cycles > latvmexit_max)
-        latvmexit_max = cycles;
-
-    if (cycles < latvmexit_min)
-        latvmexit_min = cycles;
+    latency_resume();
+    return lat_guest_entry - start;
+}
 
-    vmexit_sum += cycles;
+/* From VMMCALL until the host runs */
+static u64 latency_vmexit(void)
+{
+    latency_resume();
+    return rdtsc() - lat_guest_exit;
+}
 
-    vmcb->save.rip += 3;
+static struct bench latency_run_exit_benches[] = {
+    { .name = "vmrun", .measure = latency_vmrun },
+    { .name = "vmexit", .measure = latency_vmexit },
+};
 
-    runs -= 1;
+static void latency_run_exit(void)
+{
+    test_set_guest(latency_guest);
+    assert(svm_vmrun() == SVM_EXIT_VMMCALL);
+    bench_run_all(latency_run_exit_benches,
+                  ARRAY_SIZE(latency_run_exit_benches), 0, NULL);
+    report(true, "latency_run_exit");
+}
 
-    tsc_end = rdtsc();
+static u64 lat_vmcb_phys;
 
-    return runs == 0;
+static void lat_vmload(void)
+{
+    asm volatile("vmload %0\n\t" : : "a"(lat_vmcb_phys) : "memory");
 }
 
-static bool latency_check(struct svm_test *test)
+static void lat_vmsave(void)
 {
-    printf("    Latency VMRUN : max: %ld min: %ld avg: %ld\n", latvmrun_max,
-            latvmrun_min, vmrun_sum / LATENCY_RUNS);
-    printf("    Latency VMEXIT: max: %ld min: %ld avg: %ld\n", latvmexit_max,
-            latvmexit_min, vmexit_sum / LATENCY_RUNS);
-    return true;
+    asm volatile("vmsave %0\n\t" : : "a"(lat_vmcb_phys) : "memory");
 }
 
-static void lat_svm_insn_prepare(struct svm_test *test)
+static void lat_stgi(void)
 {
-    default_prepare(test);
-    runs = LATENCY_RUNS;
-    latvmload_min = latvmsave_min = latstgi_min = latclgi_min = -1ULL;
-    latvmload_max = latvmsave_max = latstgi_max = latclgi_max = 0;
-    vmload_sum = vmsave_sum = stgi_sum = clgi_sum;
-}
-
-static bool lat_svm_insn_finished(struct svm_test *test)
-{
-    u64 vmcb_phys = virt_to_phys(vmcb);
-    u64 cycles;
-
-    for ( ; runs != 0; runs--) {
-        tsc_start = rdtsc();
-        asm volatile("vmload %0\n\t" : : "a"(vmcb_phys) : "memory");
-        cycles = rdtsc() - tsc_start;
-        if (cycles > latvmload_max)
-            latvmload_max = cycles;
-        if (cycles < latvmload_min)
-            latvmload_min = cycles;
-        vmload_sum += cycles;
-
-        tsc_start = rdtsc();
-        asm volatile("vmsave %0\n\t" : : "a"(vmcb_phys) : "memory");
-        cycles = rdtsc() - tsc_start;
-        if (cycles > latvmsave_max)
-            latvmsave_max = cycles;
-        if (cycles < latvmsave_min)
-            latvmsave_min = cycles;
-        vmsave_sum += cycles;
-
-        tsc_start = rdtsc();
-        asm volatile("stgi\n\t");
-        cycles = rdtsc() - tsc_start;
-        if (cycles > latstgi_max)
-            latstgi_max = cycles;
-        if (cycles < latstgi_min)
-            latstgi_min = cycles;
-        stgi_sum += cycles;
-
-        tsc_start = rdtsc();
-        asm volatile("clgi\n\t");
-        cycles = rdtsc() - tsc_start;
-        if (cycles > latclgi_max)
-            latclgi_max = cycles;
-        if (cycles < latclgi_min)
-            latclgi_min = cycles;
-        clgi_sum += cycles;
-    }
-
-    tsc_end = rdtsc();
+    asm volatile("stgi\n\t");
+}
 
-    return true;
+static void lat_clgi(void)
+{
+    asm volatile("clgi\n\t");
 }
 
-static bool lat_svm_insn_check(struct svm_test *test)
+static struct bench latency_svm_insn_benches[] = {
+    BENCH("vmload", lat_vmload, .flags = BENCH_SAMPLE),
+    BENCH("vmsave", lat_vmsave, .flags = BENCH_SAMPLE),
+    BENCH("stgi", lat_stgi, .flags = BENCH_SAMPLE),
+    BENCH("clgi", lat_clgi, .flags = BENCH_SAMPLE),
+};
+
+static void latency_svm_insn(void)
 {
-    printf("    Latency VMLOAD: max: %ld min: %ld avg: %ld\n", latvmload_max,
-            latvmload_min, vmload_sum / LATENCY_RUNS);
-    printf("    Latency VMSAVE: max: %ld min: %ld avg: %ld\n", latvmsave_max,
-            latvmsave_min, vmsave_sum / LATENCY_RUNS);
-    printf("    Latency STGI:   max: %ld min: %ld avg: %ld\n", latstgi_max,
-            latstgi_min, stgi_sum / LATENCY_RUNS);
-    printf("    Latency CLGI:   max: %ld min: %ld avg: %ld\n", latclgi_max,
-            latclgi_min, clgi_sum / LATENCY_RUNS);
-    return true;
+    lat_vmcb_phys = virt_to_phys(vmcb);
+    bench_run_all(latency_svm_insn_benches,
+                  ARRAY_SIZE(latency_svm_insn_benches), 0, NULL);
+    /* The clgi benchmark leaves GIF clear */
+    asm volatile("stgi\n\t");
+    report(true, "latency_svm_insn");
 }
 
 bool pending_event_ipi_fired;
@@ -2382,6 +2316,183 @@ static void svm_vmrun_errata_test(void)
     }
 }
 
+/*
+ * Nested NPT fault-in benchmark, the counterpart of the VMX EPT fault-in
+ * benchmark.  L1 maps 1G of L2 physical memory with 4K, 2M or 1G NPT
+ * pages, either upfront or on demand from its #NPF handler, and L2 writes
+ * to every 4K page of it sequentially or in random order.  The upfront
+ * passes are repeated with a TLB flush requested in the VMCB, which is the
+ * closest SVM has to INVEPT.
+ */
+enum {
+	NPT_BENCH_SEQUENTIAL,
+	NPT_BENCH_RANDOM,
+};
+
+static struct {
+	int op;
+	u8 *hva;
+	u8 *gva;
+	u64 hpa;
+	u64 gpa;
+} npt_bench_data;
+
+#define NPT_BENCH_SIZE		(1ul << 30)
+#define NPT_BENCH_PAGES		(NPT_BENCH_SIZE / PAGE_SIZE)
+#define NPT_LEVEL_SHIFT(level)	(((level) - 1) * 9 + PAGE_SHIFT)
+
+static void npt_bench_guest(struct svm_test *test)
+{
+	unsigned long i, page = 0;
+
+	for (i = 0; i < NPT_BENCH_PAGES; i++) {
+		/*
+		 * A full-period LCG modulo the number of pages (a power
+		 * of two) visits every page exactly once.
+		 */
+		if (npt_bench_data.op == NPT_BENCH_RANDOM)
+			page = (page * 1103515245 + 12345) & (NPT_BENCH_PAGES - 1);
+		else
+			page = i;
+		npt_bench_data.gva[page * PAGE_SIZE] = 1;
+	}
+}
+
+/* Map the level-sized NPT page that contains gpa */
+static void npt_bench_map_one(int level, u64 gpa)
+{
+	u64 off = (gpa - npt_bench_data.gpa) & ~((1ul << NPT_LEVEL_SHIFT(level)) - 1);
+	u64 *pt = npt_get_pml4e(), *new_pt;
+	int l;
+
+	gpa = npt_bench_data.gpa + off;
+	for (l = 4; l > level; l--) {
+		u64 *pte = &pt[(gpa >> NPT_LEVEL_SHIFT(l)) & 511];
+
+		if (!(*pte & PT_PRESENT_MASK)) {
+			new_pt = alloc_page();
+			memset(new_pt, 0, PAGE_SIZE);
+			*pte = virt_to_phys(new_pt) | 0x027ULL;
+		}
+		pt = phys_to_virt(*pte & PT_ADDR_MASK);
+	}
+	pt[(gpa >> NPT_LEVEL_SHIFT(level)) & 511] = (npt_bench_data.hpa + off) |
+		(level > 1 ? PT_PAGE_SIZE_MASK : 0) | 0x067ULL;
+}
+
+static void npt_bench_free(u64 *pt, int level)
+{
+	int i;
+
+	for (i = 0; i < 512; i++)
+		if (level > 1 && (pt[i] & PT_PRESENT_MASK) &&
+		    !(pt[i] & PT_PAGE_SIZE_MASK))
+			npt_bench_free(phys_to_virt(pt[i] & PT_ADDR_MASK), level - 1);
+	free_page(pt);
+}
+
+/* Tear down the NPT for the benchmark memory, which has its own PML4E */
+static void npt_bench_unmap(void)
+{
+	u64 *pml4e = &npt_get_pml4e()[(npt_bench_data.gpa >> NPT_LEVEL_SHIFT(4)) & 511];
+
+	if (*pml4e & PT_PRESENT_MASK)
+		npt_bench_free(phys_to_virt(*pml4e & PT_ADDR_MASK), 3);
+	*pml4e = 0;
+	vmcb->control.tlb_ctl = TLB_CONTROL_FLUSH_ALL_ASID;
+}
+
+static void npt_bench_pass(const char *size, const char *name, int op,
+			   int level, bool on_demand)
+{
+	unsigned long exits = 0;
+	u64 start, ns;
+	int exit_code;
+
+	npt_bench_data.op = op;
+	start = rdtsc();
+	exit_code = svm_vmrun();
+	vmcb->control.tlb_ctl = TLB_CONTROL_DO_NOTHING;
+	while (exit_code == SVM_EXIT_NPF && on_demand) {
+		npt_bench_map_one(level, vmcb->control.exit_info_2);
+		exits++;
+		exit_code = svm_vmrun_resume();
+	}
+	ns = clock_ticks_to_ns(rdtsc() - start);
+	assert_msg(exit_code == SVM_EXIT_VMMCALL,
+		   "unexpected exit code %x", exit_code);
+
+	printf("%s %s: %lu pages in %" PRIu64 " us, %" PRIu64 " pages/s, %lu L1 exits\n",
+	       size, name, NPT_BENCH_PAGES, ns / 1000,
+	       (u64)NPT_BENCH_PAGES * 1000000000 / ns, exits);
+}
+
+static void npt_bench_level(const char *size, int level)
+{
+	static const char *op_names[] = { "sequential", "random" };
+	u64 off;
+	int op;
+
+	for (op = NPT_BENCH_SEQUENTIAL; op <= NPT_BENCH_RANDOM; op++) {
+		char name[40];
+
+		for (off = 0; off < NPT_BENCH_SIZE; off += 1ul << NPT_LEVEL_SHIFT(level))
+			npt_bench_map_one(level, npt_bench_data.gpa + off);
+		snprintf(name, sizeof(name), "%s first touch", op_names[op]);
+		npt_bench_pass(size, name, op, level, false);
+		vmcb->control.tlb_ctl = TLB_CONTROL_FLUSH_ALL_ASID;
+		snprintf(name, sizeof(name), "%s after TLB flush", op_names[op]);
+		npt_bench_pass(size, name, op, level, false);
+		npt_bench_unmap();
+
+		snprintf(name, sizeof(name), "%s on demand", op_names[op]);
+		npt_bench_pass(size, name, op, level, true);
+		npt_bench_unmap();
+	}
+}
+
+static void svm_npt_fault_bench(void)
+{
+	u64 off;
+
+	if (!npt_supported()) {
+		report_skip("NPT not supported");
+		return;
+	}
+
+	/* The L2 memory is at 1 << 39, in a separate PML4 entry */
+	if (cpuid_maxphyaddr() < 40) {
+		report_skip("Test needs MAXPHYADDR >= 40");
+		return;
+	}
+
+	npt_bench_data.hva = alloc_pages(30 - PAGE_SHIFT);
+	if (!npt_bench_data.hva) {
+		report_skip("Test needs 1G of contiguous memory");
+		return;
+	}
+	npt_bench_data.hpa = virt_to_phys(npt_bench_data.hva);
+
+	/* Fault in the memory in L1, so that L2 only measures L0's shadow NPT */
+	for (off = 0; off < NPT_BENCH_SIZE; off += PAGE_SIZE)
+		npt_bench_data.hva[off] = 0;
+
+	npt_bench_data.gpa = 1ul << 39;
+	npt_bench_data.gva = alloc_vpages_aligned(NPT_BENCH_PAGES, 30 - PAGE_SHIFT);
+	install_range(current_page_table(), npt_bench_data.gpa,
+		      npt_bench_data.gva, NPT_BENCH_SIZE, true);
+
+	test_set_guest(npt_bench_guest);
+	npt_bench_level("4K", 1);
+	npt_bench_level("2M", 2);
+	if (this_cpu_has(X86_FEATURE_GBPAGES))
+		npt_bench_level("1G", 3);
+
+	vmcb->control.tlb_ctl = TLB_CONTROL_FLUSH_ALL_ASID;
+	free_pages(npt_bench_data.hva);
+	report(true, "NPT fault-in benchmark");
+}
+
 struct svm_test svm_tests[] = {
     { "null", default_supported, default_prepare,
       default_prepare_gif_clear, null_test,
@@ -2455,12 +2566,6 @@ struct svm_test svm_tests[] = {
     { "tsc_adjust", tsc_adjust_supported, tsc_adjust_prepare,
       default_prepare_gif_clear, tsc_adjust_test,
       default_finished, tsc_adjust_check },
-    { "latency_run_exit", default_supported, latency_prepare,
-      default_prepare_gif_clear, latency_test,
-      latency_finished, latency_check },
-    { "latency_svm_insn", default_supported, lat_svm_insn_prepare,
-      default_prepare_gif_clear, null_test,
-      lat_svm_insn_finished, lat_svm_insn_check },
     { "exc_inject", default_supported, exc_inject_prepare,
       default_prepare_gif_clear, exc_inject_test,
       exc_inject_finished, exc_inject_check },
@@ -2495,5 +2600,8 @@ struct svm_test svm_tests[] = {
     TEST(svm_cr4_osxsave_test),
     TEST(svm_guest_state_test),
     TEST(svm_vmrun_errata_test),
+    TEST(latency_run_exit),
+    TEST(latency_svm_insn),
+    TEST(svm_npt_fault_bench),
     { NULL, NULL, NULL, NULL, NULL, NULL, NULL }
 };
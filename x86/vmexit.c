@@ -1,6 +1,7 @@
 #include "libcflat.h"
+#include "bench.h"
 #include "smp.h"
-#include "pci.h"
+#include "pci-bench.h"
 #include "x86/vm.h"
 #include "x86/desc.h"
 #include "x86/acpi.h"
@@ -9,16 +10,6 @@
 
 #define IPI_TEST_VECTOR	0xb0
 
-struct test {
-	void (*func)(void);
-	const char *name;
-	int (*valid)(void);
-	int parallel;
-	bool (*next)(struct test *);
-};
-
-#define GOAL (1ull << 30)
-
 static int nr_cpus;
 
 static void cpuid_test(void)
@@ -53,7 +44,7 @@ static void mov_to_cr8(void)
 }
 #endif
 
-static int is_smp(void)
+static bool is_smp(void)
 {
 	return cpu_count() > 1;
 }
@@ -63,8 +54,8 @@ static void nop(void *junk)
 }
 
 volatile int x = 0;
-volatile uint64_t tsc_eoi = 0;
-volatile uint64_t tsc_ipi = 0;
+volatile uint64_t tsc_eoi = 0, nr_eoi = 0;
+volatile uint64_t tsc_ipi = 0, nr_ipi = 0;
 
 static void self_ipi_isr(isr_regs_t *regs)
 {
@@ -72,6 +63,7 @@ static void self_ipi_isr(isr_regs_t *regs)
 	uint64_t start = rdtsc();
 	eoi();
 	tsc_eoi += rdtsc() - start;
+	nr_eoi++;
 }
 
 static void x2apic_self_ipi(int vec)
@@ -79,6 +71,7 @@ static void x2apic_self_ipi(int vec)
 	uint64_t start = rdtsc();
 	wrmsr(0x83f, vec);
 	tsc_ipi += rdtsc() - start;
+	nr_ipi++;
 }
 
 static void apic_self_ipi(int vec)
@@ -87,6 +80,23 @@ static void apic_self_ipi(int vec)
         apic_icr_write(APIC_INT_ASSERT | APIC_DEST_SELF | APIC_DEST_PHYSICAL |
 		       APIC_DM_FIXED | IPI_TEST_VECTOR, vec);
 	tsc_ipi += rdtsc() - start;
+	nr_ipi++;
+}
+
+/* Report the cost of sending the self-IPI and of the EOI separately */
+static void ipi_eoi_report(struct bench *b)
+{
+	struct bench_result res;
+
+	if (nr_ipi) {
+		res = (struct bench_result) { .iterations = nr_ipi, .ticks = tsc_ipi };
+		bench_print("  ipi", &res);
+	}
+	if (nr_eoi) {
+		res = (struct bench_result) { .iterations = nr_eoi, .ticks = tsc_eoi };
+		bench_print("  eoi", &res);
+	}
+	tsc_ipi = nr_ipi = tsc_eoi = nr_eoi = 0;
 }
 
 static void self_ipi_sti_nop(void)
@@ -139,7 +149,7 @@ static void self_ipi_tpr_sti_hlt(void)
 	if (x != 1) printf("%d", x);
 }
 
-static int is_x2apic(void)
+static bool is_x2apic(void)
 {
     return rdmsr(MSR_IA32_APICBASE) & APIC_EXTD;
 }
@@ -186,9 +196,7 @@ static void x2apic_self_ipi_tpr_sti_hlt(void)
 
 static void ipi(void)
 {
-	uint64_t start = rdtsc();
 	on_cpu(1, nop, 0);
-	tsc_ipi += rdtsc() - start;
 }
 
 static void ipi_halt(void)
@@ -270,152 +278,16 @@ static void wr_kernel_gs_base(void)
 	wrmsr(MSR_KERNEL_GS_BASE, 0x0);
 }
 
-static struct pci_test {
-	unsigned iobar;
-	unsigned ioport;
-	volatile void *memaddr;
-	volatile void *mem;
-	int test_idx;
-	uint32_t data;
-	uint32_t offset;
-} pci_test = {
-	.test_idx = -1
-};
-
-static void pci_mem_testb(void)
-{
-	*(volatile uint8_t *)pci_test.mem = pci_test.data;
-}
-
-static void pci_mem_testw(void)
-{
-	*(volatile uint16_t *)pci_test.mem = pci_test.data;
-}
-
-static void pci_mem_testl(void)
-{
-	*(volatile uint32_t *)pci_test.mem = pci_test.data;
-}
-
-static void pci_io_testb(void)
-{
-	outb(pci_test.data, pci_test.ioport);
-}
-
-static void pci_io_testw(void)
-{
-	outw(pci_test.data, pci_test.ioport);
-}
-
-static void pci_io_testl(void)
-{
-	outl(pci_test.data, pci_test.ioport);
-}
-
-static uint8_t ioreadb(unsigned long addr, bool io)
-{
-	if (io) {
-		return inb(addr);
-	} else {
-		return *(volatile uint8_t *)addr;
-	}
-}
-
-static uint32_t ioreadl(unsigned long addr, bool io)
-{
-	/* Note: assumes little endian */
-	if (io) {
-		return inl(addr);
-	} else {
-		return *(volatile uint32_t *)addr;
-	}
-}
-
-static void iowriteb(unsigned long addr, uint8_t data, bool io)
-{
-	if (io) {
-		outb(data, addr);
-	} else {
-		*(volatile uint8_t *)addr = data;
-	}
-}
-
-static bool pci_next(struct test *test, unsigned long addr, bool io)
-{
-	int i;
-	uint8_t width;
-
-	if (!pci_test.memaddr) {
-		test->func = NULL;
-		return true;
-	}
-	pci_test.test_idx++;
-	iowriteb(addr + offsetof(struct pci_test_dev_hdr, test),
-		 pci_test.test_idx, io);
-	width = ioreadb(addr + offsetof(struct pci_test_dev_hdr, width),
-			io);
-	switch (width) {
-		case 1:
-			test->func = io ? pci_io_testb : pci_mem_testb;
-			break;
-		case 2:
-			test->func = io ? pci_io_testw : pci_mem_testw;
-			break;
-		case 4:
-			test->func = io ? pci_io_testl : pci_mem_testl;
-			break;
-		default:
-			/* Reset index for purposes of the next test */
-			pci_test.test_idx = -1;
-			test->func = NULL;
-			return false;
-	}
-	pci_test.data = ioreadl(addr + offsetof(struct pci_test_dev_hdr, data),
-				io);
-	pci_test.offset = ioreadl(addr + offsetof(struct pci_test_dev_hdr,
-						  offset), io);
-	for (i = 0; i < pci_test.offset; ++i) {
-		char c = ioreadb(addr + offsetof(struct pci_test_dev_hdr,
-						 name) + i, io);
-		if (!c) {
-			break;
-		}
-		printf("%c",c);
-	}
-	printf(":");
-	return true;
-}
-
-static bool pci_mem_next(struct test *test)
-{
-	bool ret;
-	ret = pci_next(test, ((unsigned long)pci_test.memaddr), false);
-	if (ret) {
-		pci_test.mem = pci_test.memaddr + pci_test.offset;
-	}
-	return ret;
-}
-
-static bool pci_io_next(struct test *test)
-{
-	bool ret;
-	ret = pci_next(test, ((unsigned long)pci_test.iobar), true);
-	if (ret) {
-		pci_test.ioport = pci_test.iobar + pci_test.offset;
-	}
-	return ret;
-}
-
-static int has_tscdeadline(void)
+static bool has_tscdeadline(void)
 {
     uint32_t lvtt;
 
     if (this_cpu_has(X86_FEATURE_TSC_DEADLINE_TIMER)) {
         lvtt = APIC_LVT_TIMER_TSCDEADLINE | IPI_TEST_VECTOR;
         apic_write(APIC_LVTT, lvtt);
-        return 1;
+        return true;
     } else {
-        return 0;
+        return false;
     }
 }
 
@@ -437,7 +309,7 @@ static void wr_tsx_ctrl_msr(void)
 	wrmsr(MSR_IA32_TSX_CTRL, 0);
 }
 
-static int has_tsx_ctrl(void)
+static bool has_tsx_ctrl(void)
 {
     return this_cpu_has(X86_FEATURE_ARCH_CAPABILITIES)
 	    && (rdmsr(MSR_IA32_ARCH_CAPABILITIES) & ARCH_CAP_TSX_CTRL_MSR);
@@ -449,7 +321,12 @@ static void wr_ibrs_msr(void)
 	wrmsr(MSR_IA32_SPEC_CTRL, 0);
 }
 
-static int has_ibpb(void)
+static bool has_ibrs(void)
+{
+    return has_spec_ctrl();
+}
+
+static bool has_ibpb(void)
 {
     return has_spec_ctrl() || !!(this_cpu_has(X86_FEATURE_AMD_IBPB));
 }
@@ -459,126 +336,65 @@ static void wr_ibpb_msr(void)
 	wrmsr(MSR_IA32_PRED_CMD, 1);
 }
 
-static struct test tests[] = {
-	{ cpuid_test, "cpuid", .parallel = 1,  },
-	{ vmcall, "vmcall", .parallel = 1, },
+static struct bench tests[] = {
+	BENCH("cpuid", cpuid_test, .flags = BENCH_PARALLEL),
+	BENCH("vmcall", vmcall, .flags = BENCH_PARALLEL),
 #ifdef __x86_64__
-	{ mov_from_cr8, "mov_from_cr8", .parallel = 1, },
-	{ mov_to_cr8, "mov_to_cr8" , .parallel = 1, },
+	BENCH("mov_from_cr8", mov_from_cr8, .flags = BENCH_PARALLEL),
+	BENCH("mov_to_cr8", mov_to_cr8, .flags = BENCH_PARALLEL),
 #endif
-	{ inl_pmtimer, "inl_from_pmtimer", .parallel = 1, },
-	{ inl_nop_qemu, "inl_from_qemu", .parallel = 1 },
-	{ inl_nop_kernel, "inl_from_kernel", .parallel = 1 },
-	{ outl_elcr_kernel, "outl_to_kernel", .parallel = 1 },
-	{ mov_dr, "mov_dr", .parallel = 1 },
-	{ tscdeadline_immed, "tscdeadline_immed", has_tscdeadline, .parallel = 1, },
-	{ tscdeadline, "tscdeadline", has_tscdeadline, .parallel = 1, },
-	{ self_ipi_sti_nop, "self_ipi_sti_nop", .parallel = 0, },
-	{ self_ipi_sti_hlt, "self_ipi_sti_hlt", .parallel = 0, },
-	{ self_ipi_tpr, "self_ipi_tpr", .parallel = 0, },
-	{ self_ipi_tpr_sti_nop, "self_ipi_tpr_sti_nop", .parallel = 0, },
-	{ self_ipi_tpr_sti_hlt, "self_ipi_tpr_sti_hlt", .parallel = 0, },
-	{ x2apic_self_ipi_sti_nop, "x2apic_self_ipi_sti_nop", is_x2apic, .parallel = 0, },
-	{ x2apic_self_ipi_sti_hlt, "x2apic_self_ipi_sti_hlt", is_x2apic, .parallel = 0, },
-	{ x2apic_self_ipi_tpr, "x2apic_self_ipi_tpr", is_x2apic, .parallel = 0, },
-	{ x2apic_self_ipi_tpr_sti_nop, "x2apic_self_ipi_tpr_sti_nop", is_x2apic, .parallel = 0, },
-	{ x2apic_self_ipi_tpr_sti_hlt, "x2apic_self_ipi_tpr_sti_hlt", is_x2apic, .parallel = 0, },
-	{ ipi, "ipi", is_smp, .parallel = 0, },
-	{ ipi_halt, "ipi_halt", is_smp, .parallel = 0, },
-	{ ple_round_robin, "ple_round_robin", .parallel = 1 },
-	{ wr_kernel_gs_base, "wr_kernel_gs_base", .parallel = 1 },
-	{ wr_tsx_ctrl_msr, "wr_tsx_ctrl_msr", has_tsx_ctrl, .parallel = 1, },
-	{ wr_ibrs_msr, "wr_ibrs_msr", has_spec_ctrl, .parallel = 1 },
-	{ wr_ibpb_msr, "wr_ibpb_msr", has_ibpb, .parallel = 1 },
-	{ wr_tsc_adjust_msr, "wr_tsc_adjust_msr", .parallel = 1 },
-	{ rd_tsc_adjust_msr, "rd_tsc_adjust_msr", .parallel = 1 },
-	{ NULL, "pci-mem", .parallel = 0, .next = pci_mem_next },
-	{ NULL, "pci-io", .parallel = 0, .next = pci_io_next },
+	BENCH("inl_from_pmtimer", inl_pmtimer, .flags = BENCH_PARALLEL),
+	BENCH("inl_from_qemu", inl_nop_qemu, .flags = BENCH_PARALLEL),
+	BENCH("inl_from_kernel", inl_nop_kernel, .flags = BENCH_PARALLEL),
+	BENCH("outl_to_kernel", outl_elcr_kernel, .flags = BENCH_PARALLEL),
+	BENCH("mov_dr", mov_dr, .flags = BENCH_PARALLEL),
+	BENCH("tscdeadline_immed", tscdeadline_immed, .prep = has_tscdeadline,
+	      .report = ipi_eoi_report, .flags = BENCH_PARALLEL),
+	BENCH("tscdeadline", tscdeadline, .prep = has_tscdeadline,
+	      .report = ipi_eoi_report, .flags = BENCH_PARALLEL),
+	BENCH("self_ipi_sti_nop", self_ipi_sti_nop, .report = ipi_eoi_report),
+	BENCH("self_ipi_sti_hlt", self_ipi_sti_hlt, .report = ipi_eoi_report),
+	BENCH("self_ipi_tpr", self_ipi_tpr, .report = ipi_eoi_report),
+	BENCH("self_ipi_tpr_sti_nop", self_ipi_tpr_sti_nop, .report = ipi_eoi_report),
+	BENCH("self_ipi_tpr_sti_hlt", self_ipi_tpr_sti_hlt, .report = ipi_eoi_report),
+	BENCH("x2apic_self_ipi_sti_nop", x2apic_self_ipi_sti_nop, .prep = is_x2apic,
+	      .report = ipi_eoi_report),
+	BENCH("x2apic_self_ipi_sti_hlt", x2apic_self_ipi_sti_hlt, .prep = is_x2apic,
+	      .report = ipi_eoi_report),
+	BENCH("x2apic_self_ipi_tpr", x2apic_self_ipi_tpr, .prep = is_x2apic,
+	      .report = ipi_eoi_report),
+	BENCH("x2apic_self_ipi_tpr_sti_nop", x2apic_self_ipi_tpr_sti_nop,
+	      .prep = is_x2apic, .report = ipi_eoi_report),
+	BENCH("x2apic_self_ipi_tpr_sti_hlt", x2apic_self_ipi_tpr_sti_hlt,
+	      .prep = is_x2apic, .report = ipi_eoi_report),
+	BENCH("ipi", ipi, .prep = is_smp),
+	BENCH("ipi_halt", ipi_halt, .prep = is_smp),
+	BENCH("ple_round_robin", ple_round_robin, .flags = BENCH_PARALLEL),
+	BENCH("wr_kernel_gs_base", wr_kernel_gs_base, .flags = BENCH_PARALLEL),
+	BENCH("wr_tsx_ctrl_msr", wr_tsx_ctrl_msr, .prep = has_tsx_ctrl,
+	      .flags = BENCH_PARALLEL),
+	BENCH("wr_ibrs_msr", wr_ibrs_msr, .prep = has_ibrs, .flags = BENCH_PARALLEL),
+	BENCH("wr_ibpb_msr", wr_ibpb_msr, .prep = has_ibpb, .flags = BENCH_PARALLEL),
+	BENCH("wr_tsc_adjust_msr", wr_tsc_adjust_msr, .flags = BENCH_PARALLEL),
+	BENCH("rd_tsc_adjust_msr", rd_tsc_adjust_msr, .flags = BENCH_PARALLEL),
+	BENCH("pci-mem", NULL, .prep = pci_bench_prep,
+	      .next = pci_bench_mem_write_next),
+	BENCH("pci-io", NULL, .prep = pci_bench_prep,
+	      .next = pci_bench_io_write_next),
+	BENCH("pci-mem-read", NULL, .prep = pci_bench_prep,
+	      .next = pci_bench_mem_read_next),
+	BENCH("pci-io-read", NULL, .prep = pci_bench_prep,
+	      .next = pci_bench_io_read_next),
 };
 
-unsigned iterations;
-
-static void run_test(void *_func)
-{
-    int i;
-    void (*func)(void) = _func;
-
-    for (i = 0; i < iterations; ++i)
-        func();
-}
-
-static bool do_test(struct test *test)
-{
-	int i;
-	unsigned long long t1, t2;
-        void (*func)(void);
-
-        iterations = 32;
-
-        if (test->valid && !test->valid()) {
-		printf("%s (skipped)\n", test->name);
-		return false;
-	}
-
-	if (test->next && !test->next(test)) {
-		return false;
-	}
-
-	func = test->func;
-        if (!func) {
-		printf("%s (skipped)\n", test->name);
-		return false;
-	}
-
-	do {
-		tsc_eoi = tsc_ipi = 0;
-		iterations *= 2;
-		t1 = rdtsc();
-
-		if (!test->parallel) {
-			for (i = 0; i < iterations; ++i)
-				func();
-		} else {
-			on_cpus(run_test, func);
-		}
-		t2 = rdtsc();
-	} while ((t2 - t1) < GOAL);
-	printf("%s %d\n", test->name, (int)((t2 - t1) / iterations));
-	if (tsc_ipi)
-		printf("  ipi %s %d\n", test->name, (int)(tsc_ipi / iterations));
-	if (tsc_eoi)
-		printf("  eoi %s %d\n", test->name, (int)(tsc_eoi / iterations));
-
-	return test->next;
-}
-
 static void enable_nx(void *junk)
 {
 	if (this_cpu_has(X86_FEATURE_NX))
 		wrmsr(MSR_EFER, rdmsr(MSR_EFER) | EFER_NX_MASK);
 }
 
-static bool test_wanted(struct test *test, char *wanted[], int nwanted)
-{
-	int i;
-
-	if (!nwanted)
-		return true;
-
-	for (i = 0; i < nwanted; ++i)
-		if (strcmp(wanted[i], test->name) == 0)
-			return true;
-
-	return false;
-}
-
 int main(int ac, char **av)
 {
-	int i;
-	unsigned long membar = 0;
-	struct pci_dev pcidev;
-	int ret;
-
 	setup_vm();
 	handle_irq(IPI_TEST_VECTOR, self_ipi_isr);
 	nr_cpus = cpu_count();
@@ -586,21 +402,9 @@ int main(int ac, char **av)
 	irq_enable();
 	on_cpus(enable_nx, NULL);
 
-	ret = pci_find_dev(PCI_VENDOR_ID_REDHAT, PCI_DEVICE_ID_REDHAT_TEST);
-	if (ret != PCIDEVADDR_INVALID) {
-		pci_dev_init(&pcidev, ret);
-		assert(pci_bar_is_memory(&pcidev, PCI_TESTDEV_BAR_MEM));
-		assert(!pci_bar_is_memory(&pcidev, PCI_TESTDEV_BAR_IO));
-		membar = pcidev.resource[PCI_TESTDEV_BAR_MEM];
-		pci_test.memaddr = ioremap(membar, PAGE_SIZE);
-		pci_test.iobar = pcidev.resource[PCI_TESTDEV_BAR_IO];
-		printf("pci-testdev at %#x membar %lx iobar %x\n",
-		       pcidev.bdf, membar, pci_test.iobar);
-	}
+	pci_bench_init();
 
-	for (i = 0; i < ARRAY_SIZE(tests); ++i)
-		if (test_wanted(&tests[i], av + 1, ac - 1))
-			while (do_test(&tests[i])) {}
+	bench_run_all(tests, ARRAY_SIZE(tests), ac - 1, av + 1);
 
 	return 0;
 }
@@ -17,9 +17,11 @@
 #include "apic.h"
 #include "types.h"
 #include "vmalloc.h"
+#include "alloc.h"
 #include "alloc_page.h"
 #include "smp.h"
 #include "delay.h"
+#include "clock.h"
 
 #define NONCANONICAL            0xaaaaaaaaaaaaaaaaull
 
@@ -3239,6 +3241,371 @@ static void ept_access_test_force_2m_page(void)
 	ept_misconfig_at_level_mkhuge(true, 2, EPT_PRESENT, EPT_WA);
 }
 
+/*
+ * Nested EPT fault-in benchmark.  L1 maps 1G of L2 physical memory with
+ * 4K, 2M or 1G EPT pages, either all upfront or on demand from its EPT
+ * violation handler, and L2 writes to every 4K page of it sequentially or
+ * in random order.  With upfront mapping, all faults are handled by L0,
+ * which builds the shadow EPT; the same pass is then repeated after an
+ * INVEPT, which makes L0 tear the shadow EPT down and rebuild it.
+ */
+enum {
+	EPT_BENCH_SEQUENTIAL,
+	EPT_BENCH_RANDOM,
+	EPT_BENCH_EXIT,
+};
+
+static struct {
+	volatile int op;
+	u8 *hva;
+	u8 *gva;
+	unsigned long hpa;
+	unsigned long gpa;
+} ept_bench_data;
+
+#define EPT_BENCH_SIZE		(1ul << 30)
+#define EPT_BENCH_PAGES		(EPT_BENCH_SIZE / PAGE_SIZE)
+
+static void ept_bench_guest(void)
+{
+	unsigned long i, page = 0;
+
+	while (ept_bench_data.op != EPT_BENCH_EXIT) {
+		for (i = 0; i < EPT_BENCH_PAGES; i++) {
+			/*
+			 * A full-period LCG modulo the number of pages (a
+			 * power of two) visits every page exactly once.
+			 */
+			if (ept_bench_data.op == EPT_BENCH_RANDOM)
+				page = (page * 1103515245 + 12345) &
+				       (EPT_BENCH_PAGES - 1);
+			else
+				page = i;
+			ept_bench_data.gva[page * PAGE_SIZE] = 1;
+		}
+		vmcall();
+	}
+}
+
+/* Map the level-sized EPT page that contains gpa */
+static void ept_bench_map_one(int level, unsigned long gpa)
+{
+	unsigned long off = (gpa - ept_bench_data.gpa) &
+			    ~((1ul << EPT_LEVEL_SHIFT(level)) - 1);
+	unsigned long pte = (ept_bench_data.hpa + off) | EPT_PRESENT;
+
+	if (level > 1)
+		pte |= EPT_LARGE_PAGE;
+	install_ept_entry(pml4, level, ept_bench_data.gpa + off, pte, 0);
+}
+
+static void ept_bench_map(int level)
+{
+	unsigned long off;
+
+	for (off = 0; off < EPT_BENCH_SIZE; off += 1ul << EPT_LEVEL_SHIFT(level))
+		ept_bench_map_one(level, ept_bench_data.gpa + off);
+}
+
+static void ept_bench_free(unsigned long *pt, int level)
+{
+	int i;
+
+	for (i = 0; i < EPT_PGDIR_ENTRIES; i++)
+		if (level > 1 && (pt[i] & EPT_PRESENT) &&
+		    !(pt[i] & EPT_LARGE_PAGE))
+			ept_bench_free(phys_to_virt(pt[i] & EPT_ADDR_MASK),
+				       level - 1);
+	free_page(pt);
+}
+
+/* Tear down the L1 EPT for the benchmark memory, which has its own PML4E */
+static void ept_bench_unmap(void)
+{
+	unsigned long *pml4e = &pml4[(ept_bench_data.gpa >> EPT_LEVEL_SHIFT(4)) &
+				     EPT_PGDIR_MASK];
+
+	if (*pml4e & EPT_PRESENT)
+		ept_bench_free(phys_to_virt(*pml4e & EPT_ADDR_MASK), 3);
+	*pml4e = 0;
+	ept_sync(INVEPT_SINGLE, eptp);
+}
+
+static void ept_bench_pass(const char *size, const char *name, int op,
+			   int level, bool on_demand)
+{
+	unsigned long exits = 0;
+	u64 start, ns;
+
+	ept_bench_data.op = op;
+	start = rdtsc();
+	for (;;) {
+		enter_guest();
+		if (vmcs_read(EXI_REASON) == VMX_VMCALL)
+			break;
+		assert_exit_reason(VMX_EPT_VIOLATION);
+		TEST_ASSERT(on_demand);
+		ept_bench_map_one(level, vmcs_read(INFO_PHYS_ADDR));
+		exits++;
+	}
+	ns = clock_ticks_to_ns(rdtsc() - start);
+	skip_exit_vmcall();
+
+	printf("%s %s: %lu pages in %" PRIu64 " us, %" PRIu64 " pages/s, %lu L1 exits\n",
+	       size, name, EPT_BENCH_PAGES, ns / 1000,
+	       (u64)EPT_BENCH_PAGES * 1000000000 / ns, exits);
+}
+
+static void ept_bench_level(const char *size, int level)
+{
+	static const char *op_names[] = { "sequential", "random" };
+	int op;
+
+	for (op = EPT_BENCH_SEQUENTIAL; op <= EPT_BENCH_RANDOM; op++) {
+		char name[40];
+
+		ept_bench_map(level);
+		snprintf(name, sizeof(name), "%s first touch", op_names[op]);
+		ept_bench_pass(size, name, op, level, false);
+		ept_sync(INVEPT_SINGLE, eptp);
+		snprintf(name, sizeof(name), "%s after INVEPT", op_names[op]);
+		ept_bench_pass(size, name, op, level, false);
+		ept_bench_unmap();
+
+		snprintf(name, sizeof(name), "%s on demand", op_names[op]);
+		ept_bench_pass(size, name, op, level, true);
+		ept_bench_unmap();
+	}
+}
+
+static void vmx_ept_fault_bench(void)
+{
+	unsigned long off;
+
+	if (setup_ept(false))
+		test_skip("EPT not supported");
+	if (cpuid_maxphyaddr() < 40)
+		test_skip("Test needs MAXPHYADDR >= 40");
+
+	ept_bench_data.hva = get_1g_page();
+	if (!ept_bench_data.hva)
+		test_skip("Test needs 1G of contiguous memory");
+	ept_bench_data.hpa = virt_to_phys(ept_bench_data.hva);
+
+	/* Fault in the memory in L1, so that L2 only measures L0's shadow EPT */
+	for (off = 0; off < EPT_BENCH_SIZE; off += PAGE_SIZE)
+		ept_bench_data.hva[off] = 0;
+
+	/* Use a separate PML4 entry, as in the EPT access tests */
+	ept_bench_data.gpa = 1ul << 39;
+	ept_bench_data.gva = alloc_vpages_aligned(EPT_BENCH_PAGES,
+						  PAGE_1G_ORDER);
+	install_range(current_page_table(), ept_bench_data.gpa,
+		      ept_bench_data.gva, EPT_BENCH_SIZE, true);
+
+	test_set_guest(ept_bench_guest);
+	ept_bench_level("4K", 1);
+	if (ept_huge_pages_supported(2))
+		ept_bench_level("2M", 2);
+	if (ept_huge_pages_supported(3))
+		ept_bench_level("1G", 3);
+
+	ept_bench_data.op = EPT_BENCH_EXIT;
+	enter_guest();
+	report(true, "EPT fault-in benchmark");
+}
+
+/*
+ * Nested dirty tracking benchmark.  L2 writes to every page of a working
+ * set in rounds, and after each round L1 harvests the dirty pages, either
+ * from the PML log (draining it also on PML-full exits) or by scanning and
+ * clearing the EPT dirty bits.  The working set size in MB can be set with
+ * PML_BENCH_MB, otherwise a few sizes are measured.
+ */
+enum {
+	DIRTY_BENCH_NONE,
+	DIRTY_BENCH_PML,
+	DIRTY_BENCH_AD,
+};
+
+static struct {
+	volatile bool exit;
+	u8 *buf;
+	unsigned long pages;
+	u64 write_tsc;
+	unsigned long **ptes;
+	u64 *pml;
+} dirty_bench_data;
+
+#define DIRTY_BENCH_ROUNDS	8
+
+static void dirty_bench_guest(void)
+{
+	unsigned long i;
+	u64 start;
+
+	while (!dirty_bench_data.exit) {
+		start = rdtsc();
+		for (i = 0; i < dirty_bench_data.pages; i++)
+			dirty_bench_data.buf[i * PAGE_SIZE]++;
+		dirty_bench_data.write_tsc += rdtsc() - start;
+		vmcall();
+	}
+}
+
+static unsigned long *ept_leaf_pte(unsigned long gpa)
+{
+	unsigned long *pt = pml4, pte;
+	int l;
+
+	for (l = EPT_PAGE_LEVEL; l > 1; l--) {
+		pte = pt[(gpa >> EPT_LEVEL_SHIFT(l)) & EPT_PGDIR_MASK];
+		TEST_ASSERT((pte & EPT_PRESENT) && !(pte & EPT_LARGE_PAGE));
+		pt = phys_to_virt(pte & EPT_ADDR_MASK);
+	}
+	return &pt[(gpa >> EPT_LEVEL_SHIFT(1)) & EPT_PGDIR_MASK];
+}
+
+static bool dirty_bench_clear(unsigned long gpa)
+{
+	unsigned long i = (gpa - virt_to_phys(dirty_bench_data.buf)) >> PAGE_SHIFT;
+
+	if (i >= dirty_bench_data.pages)
+		return false;
+	*dirty_bench_data.ptes[i] &= ~EPT_DIRTY_FLAG;
+	return true;
+}
+
+static unsigned long dirty_bench_drain_pml(void)
+{
+	u16 index = vmcs_read(GUEST_PML_INDEX) + 1;
+	unsigned long harvested = 0;
+
+	/* The index wraps to 0xffff when the log is full */
+	for (; index < PML_INDEX; index++)
+		harvested += dirty_bench_clear(dirty_bench_data.pml[index] & PAGE_MASK);
+	vmcs_write(GUEST_PML_INDEX, PML_INDEX - 1);
+	return harvested;
+}
+
+static unsigned long dirty_bench_scan_ad(void)
+{
+	unsigned long i, harvested = 0;
+
+	for (i = 0; i < dirty_bench_data.pages; i++) {
+		if (*dirty_bench_data.ptes[i] & EPT_DIRTY_FLAG) {
+			*dirty_bench_data.ptes[i] &= ~EPT_DIRTY_FLAG;
+			harvested++;
+		}
+	}
+	return harvested;
+}
+
+static void dirty_bench_run(const char *mode, int tracking, unsigned long mb)
+{
+	unsigned long i, harvested = 0, pml_full = 0;
+	u64 start, t, harvest_tsc = 0, elapsed_ns, harvest_ns, write_ns;
+	u32 ctrl_cpu1 = vmcs_read(CPU_EXEC_CTRL1) & ~CPU_PML;
+	int round;
+
+	dirty_bench_data.pages = mb << (20 - PAGE_SHIFT);
+	dirty_bench_data.write_tsc = 0;
+	for (i = 0; i < dirty_bench_data.pages; i++)
+		*dirty_bench_data.ptes[i] &= ~EPT_DIRTY_FLAG;
+	ept_sync(INVEPT_SINGLE, eptp);
+
+	if (tracking == DIRTY_BENCH_PML) {
+		vmcs_write(GUEST_PML_INDEX, PML_INDEX - 1);
+		ctrl_cpu1 |= CPU_PML;
+	}
+	vmcs_write(CPU_EXEC_CTRL1, ctrl_cpu1);
+
+	start = rdtsc();
+	for (round = 0; round < DIRTY_BENCH_ROUNDS; round++) {
+		for (;;) {
+			enter_guest();
+			if (vmcs_read(EXI_REASON) != VMX_PML_FULL)
+				break;
+			t = rdtsc();
+			harvested += dirty_bench_drain_pml();
+			harvest_tsc += rdtsc() - t;
+			pml_full++;
+		}
+		skip_exit_vmcall();
+
+		if (tracking == DIRTY_BENCH_NONE)
+			continue;
+		t = rdtsc();
+		if (tracking == DIRTY_BENCH_PML)
+			harvested += dirty_bench_drain_pml();
+		else
+			harvested += dirty_bench_scan_ad();
+		/* Clean pages must be logged again on the next write */
+		ept_sync(INVEPT_SINGLE, eptp);
+		harvest_tsc += rdtsc() - t;
+	}
+	elapsed_ns = clock_ticks_to_ns(rdtsc() - start);
+	harvest_ns = clock_ticks_to_ns(harvest_tsc);
+	write_ns = clock_ticks_to_ns(dirty_bench_data.write_tsc);
+
+	printf("%s %luMB: %lu pages harvested (%" PRIu64 " pages/s), %lu PML-full exits (%" PRIu64 "/s), L2 writes %" PRIu64 " MB/s\n",
+	       mode, mb, harvested,
+	       harvest_ns ? (u64)harvested * 1000000000 / harvest_ns : 0,
+	       pml_full, (u64)pml_full * 1000000000 / elapsed_ns,
+	       (u64)mb * DIRTY_BENCH_ROUNDS * 1000000000 / write_ns);
+}
+
+static void vmx_pml_dirty_bench(void)
+{
+	static const unsigned long sizes[] = { 4, 64, 512 };
+	unsigned long i, mb, max_mb = 0;
+	const char *env = getenv("PML_BENCH_MB");
+	bool have_pml;
+
+	if (!ept_ad_bits_supported())
+		test_skip("EPT AD bits not supported");
+	/* With A/D bits enabled, setup_ept() maps memory with 4K pages */
+	if (setup_ept(true))
+		test_skip("EPT not supported");
+	have_pml = (ctrl_cpu_rev[0].clr & CPU_SECONDARY) &&
+		   (ctrl_cpu_rev[1].clr & CPU_PML);
+	if (!have_pml)
+		printf("PML not supported, only measuring A/D scanning\n");
+
+	if (env)
+		max_mb = atol(env);
+	else
+		for (i = 0; i < ARRAY_SIZE(sizes); i++)
+			max_mb = MAX(max_mb, sizes[i]);
+
+	dirty_bench_data.buf = alloc_pages(get_order(max_mb << (20 - PAGE_SHIFT)));
+	if (!dirty_bench_data.buf)
+		test_skip("Not enough memory for the working set");
+	dirty_bench_data.ptes = malloc((max_mb << (20 - PAGE_SHIFT)) *
+				       sizeof(*dirty_bench_data.ptes));
+	for (i = 0; i < max_mb << (20 - PAGE_SHIFT); i++)
+		dirty_bench_data.ptes[i] =
+			ept_leaf_pte(virt_to_phys(dirty_bench_data.buf) + i * PAGE_SIZE);
+	dirty_bench_data.pml = alloc_page();
+	vmcs_write(PMLADDR, virt_to_phys(dirty_bench_data.pml));
+
+	test_set_guest(dirty_bench_guest);
+	for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+		mb = env ? max_mb : sizes[i];
+		dirty_bench_run("untracked", DIRTY_BENCH_NONE, mb);
+		if (have_pml)
+			dirty_bench_run("PML", DIRTY_BENCH_PML, mb);
+		dirty_bench_run("A/D scan", DIRTY_BENCH_AD, mb);
+		if (env)
+			break;
+	}
+
+	dirty_bench_data.exit = true;
+	enter_guest();
+	free(dirty_bench_data.ptes);
+	report(true, "PML dirty tracking benchmark");
+}
+
 static bool invvpid_valid(u64 type, u64 vpid, u64 gla)
 {
 	u64 msr = rdmsr(MSR_IA32_VMX_EPT_VPID_CAP);
@@ -10339,6 +10706,159 @@ static void vmx_vmcs_shadow_test(void)
 	enter_guest();
 }
 
+/*
+ * VMCS shadowing benchmark: L2 acts as a nested hypervisor and accesses
+ * the fields that an exit handler typically uses, with all, none, or the
+ * commonly shadowed ones (as chosen by KVM) permitted in the VMREAD and
+ * VMWRITE bitmaps.  Non-shadowed accesses exit to L1, which just skips
+ * them.
+ */
+struct vmcs_shadow_bench_field {
+	u64 field;
+	bool common;
+};
+
+static const struct vmcs_shadow_bench_field vmcs_shadow_bench_fields[] = {
+	{ EXI_REASON, true },
+	{ EXI_QUALIFICATION, true },
+	{ EXI_INST_LEN, true },
+	{ EXI_INTR_INFO, true },
+	{ GUEST_RIP, true },
+	{ GUEST_RSP, true },
+	{ GUEST_RFLAGS, true },
+	{ GUEST_CR0, true },
+	{ GUEST_CR3, true },
+	{ GUEST_CR4, true },
+	{ GUEST_INTR_STATE, true },
+	{ ENT_INTR_INFO, true },
+	{ GUEST_SEL_CS, false },
+	{ GUEST_DR7, false },
+	{ GUEST_SYSENTER_EIP, false },
+	{ CR0_MASK, false },
+};
+
+#define VMCS_SHADOW_BENCH_ITERS	1000
+
+static struct {
+	volatile enum vmcs_access op;
+	u64 tsc;
+	unsigned long accesses;
+} vmcs_shadow_bench_data;
+
+/* VM-exit information fields are read-only */
+static bool vmcs_field_is_ro(u64 field)
+{
+	return ((field >> VMCS_FIELD_TYPE_SHIFT) & 3) == 1;
+}
+
+static void vmcs_shadow_bench_guest(void)
+{
+	const struct vmcs_shadow_bench_field *f;
+	unsigned long accesses;
+	u64 start, value = 0;
+	int i;
+
+	while (vmcs_shadow_bench_data.op != ACCESS_NONE) {
+		accesses = 0;
+		start = rdtsc();
+		for (i = 0; i < VMCS_SHADOW_BENCH_ITERS; i++) {
+			for (f = vmcs_shadow_bench_fields;
+			     f < vmcs_shadow_bench_fields + ARRAY_SIZE(vmcs_shadow_bench_fields);
+			     f++) {
+				if (vmcs_shadow_bench_data.op == ACCESS_VMREAD) {
+					asm volatile ("vmread %1, %0"
+						      : "=r" (value) : "r" (f->field) : "cc");
+				} else if (!vmcs_field_is_ro(f->field)) {
+					asm volatile ("vmwrite %0, %1"
+						      : : "r" (value), "r" (f->field) : "cc");
+				} else {
+					continue;
+				}
+				accesses++;
+			}
+		}
+		vmcs_shadow_bench_data.tsc = rdtsc() - start;
+		vmcs_shadow_bench_data.accesses = accesses;
+		vmcall();
+	}
+}
+
+static void vmcs_shadow_bench_run(const char *name, enum vmcs_access op)
+{
+	unsigned long exits = 0;
+	u32 reason;
+
+	vmcs_shadow_bench_data.op = op;
+	for (;;) {
+		enter_guest();
+		reason = vmcs_read(EXI_REASON) & 0xffff;
+		if (reason != VMX_VMREAD && reason != VMX_VMWRITE)
+			break;
+		skip_exit_insn();
+		exits++;
+	}
+	skip_exit_vmcall();
+
+	printf("%s %s: %" PRIu64 " cycles/access, %lu of %lu accesses exited to L1\n",
+	       name, op == ACCESS_VMREAD ? "VMREAD" : "VMWRITE",
+	       vmcs_shadow_bench_data.tsc / vmcs_shadow_bench_data.accesses,
+	       exits, vmcs_shadow_bench_data.accesses);
+}
+
+static void vmx_vmcs_shadow_bench(void)
+{
+	const struct vmcs_shadow_bench_field *f;
+	u8 *bitmap[2];
+	struct vmcs *shadow;
+	int i;
+
+	if (!(ctrl_cpu_rev[0].clr & CPU_SECONDARY) ||
+	    !(ctrl_cpu_rev[1].clr & CPU_SHADOW_VMCS))
+		test_skip("'VMCS shadowing' not supported");
+
+	test_set_guest(vmcs_shadow_bench_guest);
+
+	bitmap[ACCESS_VMREAD] = alloc_page();
+	bitmap[ACCESS_VMWRITE] = alloc_page();
+	vmcs_write(VMREAD_BITMAP, virt_to_phys(bitmap[ACCESS_VMREAD]));
+	vmcs_write(VMWRITE_BITMAP, virt_to_phys(bitmap[ACCESS_VMWRITE]));
+
+	shadow = alloc_page();
+	shadow->hdr.revision_id = basic.revision;
+	shadow->hdr.shadow_vmcs = 1;
+	TEST_ASSERT(!vmcs_clear(shadow));
+
+	vmcs_clear_bits(CPU_EXEC_CTRL0, CPU_RDTSC);
+	vmcs_set_bits(CPU_EXEC_CTRL0, CPU_SECONDARY);
+	vmcs_set_bits(CPU_EXEC_CTRL1, CPU_SHADOW_VMCS);
+	vmcs_write(VMCS_LINK_PTR, virt_to_phys(shadow));
+
+	for (i = 0; i < 2; i++)
+		memset(bitmap[i], 0, PAGE_SIZE);
+	vmcs_shadow_bench_run("all shadowed", ACCESS_VMREAD);
+	vmcs_shadow_bench_run("all shadowed", ACCESS_VMWRITE);
+
+	for (i = 0; i < 2; i++)
+		memset(bitmap[i], 0xff, PAGE_SIZE);
+	vmcs_shadow_bench_run("none shadowed", ACCESS_VMREAD);
+	vmcs_shadow_bench_run("none shadowed", ACCESS_VMWRITE);
+
+	for (f = vmcs_shadow_bench_fields;
+	     f < vmcs_shadow_bench_fields + ARRAY_SIZE(vmcs_shadow_bench_fields);
+	     f++) {
+		if (!f->common)
+			continue;
+		clear_bit(f->field, bitmap[ACCESS_VMREAD]);
+		clear_bit(f->field, bitmap[ACCESS_VMWRITE]);
+	}
+	vmcs_shadow_bench_run("common fields shadowed", ACCESS_VMREAD);
+	vmcs_shadow_bench_run("common fields shadowed", ACCESS_VMWRITE);
+
+	vmcs_shadow_bench_data.op = ACCESS_NONE;
+	enter_guest();
+	report(true, "VMCS shadowing benchmark");
+}
+
 /*
  * This test monitors the difference between a guest RDTSC instruction
  * and the IA32_TIME_STAMP_COUNTER MSR value stored in the VMCS12
@@ -10699,6 +11219,10 @@ struct vmx_test vmx_tests[] = {
 	TEST(ept_access_test_paddr_read_execute_ad_enabled),
 	TEST(ept_access_test_paddr_not_present_page_fault),
 	TEST(ept_access_test_force_2m_page),
+	/* Benchmarks. */
+	TEST(vmx_ept_fault_bench),
+	TEST(vmx_pml_dirty_bench),
+	TEST(vmx_vmcs_shadow_bench),
 	/* Atomic MSR switch tests. */
 	TEST(atomic_switch_max_msrs_test),
 	TEST(atomic_switch_overflow_msrs_test),